@@ -0,0 +1,374 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "game.h"
+#include "house.h"
+#include "mapfile.h"
+#include "trace.h"
+
+// 性能基准：地图加载和模拟步的耗时，改了游戏逻辑以后用来发现性能回退
+// 除了地图包里的地图，还会生成几张不同大小的合成地图，看耗时怎么随地图大小变化
+// 渲染的耗时由 plane --bench 测（渲染器在 plane.c 里），两者输出的格式相同
+//
+// 用法: bench [--maps 地图包] [--quick] [--json]
+//
+// 每条结果一行；--json 时每行是一个 JSON 对象，方便和上一次的结果逐条比较:
+//   load  地图包  打开地图包 (mmap + 检查文件头) 的耗时
+//   open  地图    第一次 map_get：检查目录项、算导航距离场和视野
+//   cycle 地图包  打开地图包、读一遍所有地图再卸载的总耗时，和其中卸载 (maps_unload) 的耗时
+//   start 来源    启动到所有地图都能用的耗时：内置地图 (builtin) 和地图包各测一次
+//   tick  地图    房间里有 N 个人时 game_step / move_npcs / check_collisions 每步的耗时
+//   house 大小    整栋房子：生成第一个窗口的耗时，随机走动时窗口挪动一次（生成新块、导航和视野）的中位数和最大值
+// 时间都是纳秒，取几次重复里的中位数
+
+#define REPEATS 5
+
+static int json = 0;
+static int quick = 0;
+
+static const int npc_counts[] = { 0, 2, 8, 32, 128, 512 };
+
+// 合成地图的大小
+static const int synth_sizes[][2] = { { 40, 10 }, { 80, 24 }, { 160, 48 }, { 320, 96 } };
+#define SYNTH_COUNT (int)(sizeof(synth_sizes) / sizeof(synth_sizes[0]))
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double median(double *v, int n) {
+    qsort(v, n, sizeof(double), cmp_double);
+    return v[n / 2];
+}
+
+static void print_load(const char *pack, double ns) {
+    if (json) {
+        printf("{\"bench\":\"load\",\"pack\":\"%s\",\"ns\":%.0f}\n", pack, ns);
+    } else {
+        printf("load  %-24s %14.0f ns\n", pack, ns);
+    }
+}
+
+static void print_cycle(const char *pack, double ns, double unload_ns) {
+    if (json) {
+        printf("{\"bench\":\"cycle\",\"pack\":\"%s\",\"ns\":%.0f,\"unload_ns\":%.0f}\n", pack, ns, unload_ns);
+    } else {
+        printf("cycle %-24s %14.0f ns  卸载 %10.0f ns\n", pack, ns, unload_ns);
+    }
+}
+
+static void print_start(const char *source, int maps, double ns) {
+    if (json) {
+        printf("{\"bench\":\"start\",\"source\":\"%s\",\"maps\":%d,\"ns\":%.0f}\n", source, maps, ns);
+    } else {
+        printf("start %-24s %4d 张 %14.0f ns\n", source, maps, ns);
+    }
+}
+
+static void print_open(const GameMap *m, double ns) {
+    if (json) {
+        printf("{\"bench\":\"open\",\"map\":\"%s\",\"width\":%d,\"height\":%d,\"ns\":%.0f}\n",
+               m->map_id, m->width, m->height, ns);
+    } else {
+        printf("open  %-16s %4dx%-4d %14.0f ns\n", m->map_id, m->width, m->height, ns);
+    }
+}
+
+static void print_tick(const GameMap *m, int npcs, double step_ns, double move_ns, double check_ns) {
+    if (json) {
+        printf("{\"bench\":\"tick\",\"map\":\"%s\",\"width\":%d,\"height\":%d,\"npcs\":%d,"
+               "\"step_ns\":%.1f,\"move_ns\":%.1f,\"check_ns\":%.1f,\"steps_per_sec\":%.0f}\n",
+               m->map_id, m->width, m->height, npcs, step_ns, move_ns, check_ns, 1e9 / step_ns);
+    } else {
+        printf("tick  %-16s %4dx%-4d %4d 人  步 %10.1f ns  移动 %10.1f ns  碰撞 %10.1f ns  %12.0f 步/秒\n",
+               m->map_id, m->width, m->height, npcs, step_ns, move_ns, check_ns, 1e9 / step_ns);
+    }
+}
+
+// 生成一张 width x height 的合成地图：四周是墙，每隔20列一道有缺口的隔墙，
+// 左边是床，右下角是隐藏区域，门在左上角和左下角
+static void synth_map(GameMap *m, char *name, int width, int height) {
+    char **rows = malloc(height * sizeof(char *));
+    uint8_t *zones = calloc((size_t)width * height, 1);
+    MapPoint *doors = malloc(2 * sizeof(MapPoint));
+    
+    for (int y = 0; y < height; y++) {
+        rows[y] = malloc(width + 1);
+        for (int x = 0; x < width; x++) {
+            int wall = x == 0 || y == 0 || x == width - 1 || y == height - 1 ||
+                       (x % 20 == 0 && y % 8 != 4);
+            rows[y][x] = wall ? '#' : ' ';
+        }
+        rows[y][width] = 0;
+    }
+    for (int y = 2; y <= 4 && y < height - 1; y++) {
+        for (int x = 4; x <= 6; x++) {
+            zones[y * width + x] = ZONE_BED;
+        }
+    }
+    for (int y = height - 4; y < height - 1; y++) {
+        for (int x = width - 8; x < width - 1; x++) {
+            zones[y * width + x] = ZONE_HIDE | 1 << 4;
+        }
+    }
+    doors[0] = (MapPoint){ 1, 1 };
+    doors[1] = (MapPoint){ 1, height - 2 };
+    
+    sprintf(name, "SYNTH_%dx%d", width, height);
+    memset(m, 0, sizeof(*m));
+    m->map_name = name;
+    m->map_id = name;
+    m->hint = "";
+    m->spawn_x = 5;
+    m->spawn_y = 3;
+    m->hide_count = 1;
+    m->door_count = 2;
+    m->doors = doors;
+    map_compile(m, (const char *const *)rows, height, zones, width);
+    
+    for (int y = 0; y < height; y++) {
+        free(rows[y]);
+    }
+    free(rows);
+    free(zones);
+}
+
+// 把合成地图写成临时地图包，测加载时和真的地图包走同一条路
+static int write_synth_pack(const char *path) {
+    GameMap list[SYNTH_COUNT];
+    char names[SYNTH_COUNT][32];
+    
+    for (int i = 0; i < SYNTH_COUNT; i++) {
+        synth_map(&list[i], names[i], synth_sizes[i][0], synth_sizes[i][1]);
+        list[i].type = (MapType)i;
+    }
+    int ok = mappack_write(path, list, SYNTH_COUNT);
+    for (int i = 0; i < SYNTH_COUNT; i++) {
+        free((void *)list[i].cells);
+        free((void *)list[i].doors);
+    }
+    return ok;
+}
+
+// 打开地图包和第一次读每张地图的耗时，每次都重新打开，保证是冷的
+static int bench_load(const char *path, const char *label) {
+    const char *err;
+    int reps = quick ? 1 : REPEATS;
+    double load_ns[REPEATS], cycle_ns[REPEATS], unload_ns[REPEATS];
+    double *open_ns = NULL;
+    int count = 0;
+    
+    for (int r = 0; r < reps; r++) {
+        uint64_t t0 = trace_now();
+        if (!maps_load(path, &err)) {
+            fprintf(stderr, "%s: %s\n", path, err);
+            free(open_ns);
+            return 0;
+        }
+        load_ns[r] = trace_now() - t0;
+        
+        if (!open_ns) {
+            count = map_count;
+            open_ns = calloc((size_t)count * REPEATS, sizeof(double));
+        }
+        for (int i = 0; i < count; i++) {
+            t0 = trace_now();
+            map_get(i);
+            open_ns[i * REPEATS + r] = trace_now() - t0;
+        }
+        t0 = trace_now();
+        maps_unload();
+        unload_ns[r] = trace_now() - t0;
+        cycle_ns[r] = load_ns[r] + unload_ns[r];
+        for (int i = 0; i < count; i++) {
+            cycle_ns[r] += open_ns[i * REPEATS + r];
+        }
+    }
+    
+    print_load(label, median(load_ns, reps));
+    print_cycle(label, median(cycle_ns, reps), median(unload_ns, reps));
+    maps_load(path, &err);
+    for (int i = 0; i < count; i++) {
+        const GameMap *m = map_get(i);
+        if (m) {
+            print_open(m, median(&open_ns[i * REPEATS], reps));
+        }
+    }
+    free(open_ns);
+    return 1;
+}
+
+// 启动时准备地图的耗时：打开地图包（path 为 NULL 时用内置地图）并把每张地图读一遍
+static int bench_start(const char *path) {
+    const char *err;
+    int reps = quick ? 1 : REPEATS;
+    double ns[REPEATS];
+    int maps = 0;
+    
+    for (int r = 0; r < reps; r++) {
+        uint64_t t0 = trace_now();
+        if (!path) {
+            maps_use_builtin(builtin_maps, builtin_map_count);
+        } else if (!maps_load(path, &err)) {
+            fprintf(stderr, "%s: %s\n", path, err);
+            return 0;
+        }
+        for (int i = 0; i < map_count; i++) {
+            map_get(i);
+        }
+        ns[r] = trace_now() - t0;
+        maps = map_count;
+        maps_unload();
+    }
+    print_start(path ? path : "builtin", maps, median(ns, reps));
+    return 1;
+}
+
+// 对同一个开局状态重复执行一个函数，返回每次的平均耗时
+static double time_fn(const GameContext *start, void (*fn)(GameContext *), long ticks) {
+    GameContext g = *start;
+    
+    uint64_t t0 = trace_now();
+    for (long t = 0; t < ticks; t++) {
+        fn(&g);
+        g.state = PLAYING;  // 抓到玩家也接着跑
+    }
+    return (double)(trace_now() - t0) / ticks;
+}
+
+static void step_none(GameContext *g) {
+    game_step(g, INPUT_NONE);
+}
+
+// 房间里一直保持 n 个家人（不会自己离开），玩家待在床上
+static void bench_ticks(int map) {
+    const GameMap *m = map_get(map);
+    if (!m) return;
+    
+    for (size_t s = 0; s < sizeof(npc_counts) / sizeof(npc_counts[0]); s++) {
+        int n = npc_counts[s];
+        GameRules r = default_rules;
+        r.max_npcs = n;
+        r.check_interval = 1 << 30;
+        r.parent_time = 1 << 30;
+        r.win_time = 1 << 30;
+        
+        GameContext start;
+        game_init(&start, (MapType)map, &r, 20240101);
+        for (int k = 0; k < n; k++) {
+            npc_spawn(&start, (NpcKind)(k % NPC_KIND_COUNT));
+        }
+        // 先走一段，让大家从门口散开，碰撞检测测的才是平常的分布
+        for (int t = 0; t < 200; t++) {
+            move_npcs(&start);
+        }
+        
+        // 每档的总工作量差不多：人越多步数越少
+        long ticks = (quick ? 400000L : 4000000L) / (n + 1);
+        double step[REPEATS], move[REPEATS], check[REPEATS];
+        int reps = quick ? 1 : REPEATS;
+        for (int k = 0; k < reps; k++) {
+            step[k] = time_fn(&start, step_none, ticks);
+            move[k] = time_fn(&start, move_npcs, ticks);
+            check[k] = time_fn(&start, check_collisions, ticks);
+        }
+        print_tick(m, n, median(step, reps), median(move, reps), median(check, reps));
+    }
+}
+
+// 整栋房子：玩家随机乱走，记下每次窗口挪动那一步的耗时
+static void bench_house(int width, int height) {
+    uint64_t t0 = trace_now();
+    House *h = house_new(20240101, width, height);
+    double new_ns = trace_now() - t0;
+    
+    GameContext g;
+    GameRng r;
+    game_init_map(&g, &h->window, NULL, 1);
+    g.rules.check_interval = 1 << 30;
+    rng_seed(&r, 7);
+    
+    static double shift_ns[4096];
+    int shifts = 0;
+    long steps = quick ? 20000 : 200000;
+    GameInput dir = INPUT_RIGHT;
+    for (long i = 0; i < steps && shifts < 4096; i++) {
+        if (rng_range(&r, 30) == 0) {
+            dir = (GameInput)(1 + rng_range(&r, 4));
+        }
+        int ox = h->org_cx, oy = h->org_cy;
+        t0 = trace_now();
+        game_input(&g, dir);
+        uint64_t dt = trace_now() - t0;
+        if (h->org_cx != ox || h->org_cy != oy) {
+            shift_ns[shifts++] = dt;
+        }
+    }
+    
+    double p50 = 0, max = 0;
+    for (int i = 0; i < shifts; i++) {
+        max = shift_ns[i] > max ? shift_ns[i] : max;
+    }
+    if (shifts > 0) {
+        p50 = median(shift_ns, shifts);
+    }
+    if (json) {
+        printf("{\"bench\":\"house\",\"width\":%d,\"height\":%d,\"new_ns\":%.0f,\"shifts\":%d,"
+               "\"shift_p50_ns\":%.0f,\"shift_max_ns\":%.0f,\"chunks_generated\":%d}\n",
+               width, height, new_ns, shifts, p50, max, h->generated);
+    } else {
+        printf("house %5dx%-5d 建窗口 %12.0f ns  挪动 %4d 次  中位数 %12.0f ns  最大 %12.0f ns  生成 %d 块\n",
+               width, height, new_ns, shifts, p50, max, h->generated);
+    }
+    house_free(h);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "用法: %s [--maps 地图包] [--quick] [--json]\n", prog);
+}
+
+int main(int argc, char *argv[]) {
+    const char *maps_path = "maps.pack";
+    
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--maps") == 0 && i + 1 < argc) {
+            maps_path = argv[++i];
+        } else if (strcmp(argv[i], "--quick") == 0) {
+            quick = 1;
+        } else if (strcmp(argv[i], "--json") == 0) {
+            json = 1;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    
+    char synth_path[] = "/tmp/bench-maps-XXXXXX";
+    int fd = mkstemp(synth_path);
+    if (fd < 0 || !write_synth_pack(synth_path)) {
+        fprintf(stderr, "无法写入临时地图包\n");
+        return 1;
+    }
+    close(fd);
+    
+    const char *paths[2] = { maps_path, synth_path };
+    const char *labels[2] = { maps_path, "synthetic" };
+    int ok = bench_start(NULL) && bench_start(maps_path);
+    for (int p = 0; p < 2 && ok; p++) {
+        ok = bench_load(paths[p], labels[p]);
+        for (int i = 0; ok && i < map_count; i++) {
+            bench_ticks(i);
+        }
+        maps_unload();
+    }
+    
+    unlink(synth_path);
+    
+    // 两种大小的耗时应该差不多，窗口挪动的开销与房子大小无关
+    bench_house(512, 512);
+    bench_house(4096, 4096);
+    return ok ? 0 : 1;
+}
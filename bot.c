@@ -0,0 +1,131 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "bot.h"
+#include "snapshot.h"
+#include "trace.h"
+
+#define LOST_VALUE (-1000000)
+
+static uint64_t mix64(uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+// FNV-1a，快照只有一两百字节
+static uint64_t hash_bytes(const unsigned char *p, size_t n) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < n; i++) {
+        h = (h ^ p[i]) * 0x100000001b3ULL;
+    }
+    return h;
+}
+
+Bot *bot_new(void) {
+    Bot *b = calloc(1, sizeof(Bot));
+    b->scenarios = 8;
+    b->depth = 2;
+    b->horizon = 80;
+    b->budget_ns = 20000000;
+    return b;
+}
+
+void bot_free(Bot *b) {
+    free(b);
+}
+
+GameInput bot_greedy(const GameContext *g) {
+    int danger = g->warning_timer > 0 || g->npcs.count > 0;
+    return nav_step(g->map, danger ? NAV_HIDE : NAV_BED, g->player.x, g->player.y);
+}
+
+// 局面的分数：被抓时越晚越好，否则看得分
+static int32_t evaluate(const GameContext *g) {
+    if (g->state == LOST) return LOST_VALUE + g->game_time;
+    return g->player.score;
+}
+
+static int32_t rollout(Bot *b, GameContext *g) {
+    b->rollouts++;
+    for (int t = 0; t < b->horizon && g->state == PLAYING; t++) {
+        game_step(g, bot_greedy(g));
+    }
+    return evaluate(g);
+}
+
+// 在 g 上往下搜 depth 步，返回最好的分数；g 会被改掉
+static int32_t search(Bot *b, GameContext *g, int depth) {
+    if (g->state != PLAYING || depth == 0) {
+        return rollout(b, g);
+    }
+    b->nodes++;
+    
+    unsigned char snap[SNAPSHOT_MAX_SIZE];
+    size_t size = snapshot_save(g, snap);
+    uint64_t key = hash_bytes(snap, size) ^ mix64((uint64_t)depth);
+    BotEntry *e = &b->tt[key & (BOT_TT_SIZE - 1)];
+    if (e->key == key) {
+        b->tt_hits++;
+        return e->value;
+    }
+    
+    int32_t best = LOST_VALUE - 1;
+    GameContext c;
+    c.map = g->map;
+    for (int a = INPUT_NONE; a <= INPUT_RIGHT; a++) {
+        snapshot_restore(&c, snap);
+        game_step(&c, (GameInput)a);
+        int32_t v = search(b, &c, depth - 1);
+        if (v > best) {
+            best = v;
+        }
+    }
+    e->key = key;
+    e->value = best;
+    return best;
+}
+
+GameInput bot_choose(Bot *b, const GameContext *g) {
+    if (g->state != PLAYING) return INPUT_NONE;
+    if (g->map->house) return bot_greedy(g);
+    
+    uint64_t t0 = trace_now();
+    unsigned char root[SNAPSHOT_MAX_SIZE], scene[SNAPSHOT_MAX_SIZE];
+    snapshot_save(g, root);
+    
+    // 每种未来的种子只由这一局和这一步决定，同样的局面总是做同样的决定
+    int64_t sum[INPUT_RIGHT + 1] = { 0 };
+    GameContext c;
+    c.map = g->map;
+    for (int s = 0; s < b->scenarios; s++) {
+        if (b->budget_ns && s > 0 && trace_now() - t0 > b->budget_ns) break;
+        
+        snapshot_restore(&c, root);
+        rng_seed(&c.rng, mix64(g->seed ^ mix64(((uint64_t)g->game_time << 16) ^ (uint64_t)s)));
+        snapshot_save(&c, scene);
+        for (int a = INPUT_NONE; a <= INPUT_RIGHT; a++) {
+            if (a > INPUT_NONE) {
+                snapshot_restore(&c, scene);
+            }
+            game_step(&c, (GameInput)a);
+            sum[a] += search(b, &c, b->depth - 1);
+        }
+    }
+    
+    // 一样好时选靠前的，INPUT_NONE 排在最前，能不动就不动
+    int best = INPUT_NONE;
+    for (int a = INPUT_NONE + 1; a <= INPUT_RIGHT; a++) {
+        if (sum[a] > sum[best]) {
+            best = a;
+        }
+    }
+    
+    uint64_t dt = trace_now() - t0;
+    b->decisions++;
+    b->think_ns += dt;
+    if (dt > b->think_max_ns) {
+        b->think_max_ns = dt;
+    }
+    return (GameInput)best;
+}
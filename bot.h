@@ -0,0 +1,54 @@
+#ifndef BOT_H
+#define BOT_H
+
+#include <stdint.h>
+
+#include "game.h"
+
+// 自动玩家：每一步在几种可能的未来里做前瞻搜索，挑期望最好的操作
+// 家人什么时候来、从哪扇门进来都由游戏的随机数决定。每步把局面克隆 scenarios 份，各自重新播种，
+// 就是几种不同的未来；在每种未来里对玩家的操作做 depth 步的完全搜索，之后用 bot_greedy 推演 horizon 步打分，
+// 第一步操作的分数取它在所有未来里的平均值（抽样的 expectimax）
+//
+// 局面用快照 (snapshot.h) 克隆。同一个局面（连同随机数状态）往下的搜索结果总是一样的，存在置换表里，
+// 先上后下、撞墙和原地不动这类走到同一个局面的操作序列只算一次
+//
+// 打分：被抓最差，越晚被抓越好；推演结束还没被抓就按得分算，所以没人来的时候会回床上玩
+// 整栋房子模式下玩家走远了窗口会挪动，搜索不能在克隆的局面上走，这时直接用 bot_greedy
+
+#define BOT_TT_SIZE 4096   // 置换表项数，2 的幂
+
+typedef struct {
+    uint64_t key;
+    int32_t value;
+    int32_t pad;
+} BotEntry;
+
+typedef struct {
+    int scenarios;          // 每步抽几种未来
+    int depth;              // 完全搜索几步
+    int horizon;            // 之后推演几步
+    uint64_t budget_ns;     // 每步的时间上限，到了就不再抽新的未来；0 表示不限，结果可以复现
+
+    // 统计
+    long decisions;
+    long long nodes;        // 搜索展开的局面数
+    long long rollouts;
+    long long tt_hits;
+    uint64_t think_ns;      // 决策总耗时
+    uint64_t think_max_ns;  // 最慢的一步
+
+    BotEntry tt[BOT_TT_SIZE];
+} Bot;
+
+// 默认参数：8 种未来，搜 2 步，推演 80 步（8 秒），每步最多 20 毫秒
+Bot *bot_new(void);
+void bot_free(Bot *b);
+
+// 给当前局面挑一个操作，g 不会被修改
+GameInput bot_choose(Bot *b, const GameContext *g);
+
+// 推演用的简单策略：有人在房间里或有警告就去躲，否则回床上
+GameInput bot_greedy(const GameContext *g);
+
+#endif
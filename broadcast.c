@@ -0,0 +1,168 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "broadcast.h"
+
+typedef struct {
+    int fd;
+    uint64_t pos;   // 下一个要发给这个观众的字节（从开播算起的绝对位置）
+} Viewer;
+
+static char ring[BCAST_RING_SIZE];
+static uint64_t head = 0;          // 已经追加的字节数
+static uint64_t committed = 0;     // 已经写完整的帧的末尾，观众只读到这里
+static uint64_t frame_start = 0;
+static uint64_t keyframe_pos = 0;  // 最近一个关键帧的开头
+static int have_keyframe = 0;
+static int frame_is_key = 0;
+static int force_key = 1;
+static long long last_keyframe_us = 0;
+
+static int listen_fd = -1;
+static Viewer viewers[BCAST_MAX_VIEWERS];
+static int viewer_count = 0;
+
+static long long mono_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+int bcast_open(const char *path) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(addr.sun_path)) return 0;
+    strcpy(addr.sun_path, path);
+    
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    unlink(path);
+    if (listen_fd < 0 || bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(listen_fd, 16) != 0) {
+        if (listen_fd >= 0) {
+            close(listen_fd);
+        }
+        listen_fd = -1;
+        return 0;
+    }
+    return 1;
+}
+
+void bcast_close() {
+    for (int i = 0; i < viewer_count; i++) {
+        close(viewers[i].fd);
+    }
+    viewer_count = 0;
+    if (listen_fd >= 0) {
+        close(listen_fd);
+        listen_fd = -1;
+    }
+}
+
+int bcast_active() {
+    return listen_fd >= 0;
+}
+
+int bcast_begin_frame() {
+    // 离上一个关键帧太久，或者中间的数据快把环形缓冲区写满了，这一帧就写成关键帧
+    long long now = mono_us();
+    frame_start = head;
+    frame_is_key = force_key || !have_keyframe || now - last_keyframe_us >= BCAST_KEYFRAME_US ||
+                   head - keyframe_pos > BCAST_RING_SIZE / 4;
+    if (frame_is_key) {
+        force_key = 0;
+        last_keyframe_us = now;
+    }
+    return frame_is_key;
+}
+
+void bcast_write(const void *data, size_t n) {
+    const char *p = data;
+    while (n > 0) {
+        size_t off = head % BCAST_RING_SIZE;
+        size_t chunk = BCAST_RING_SIZE - off < n ? BCAST_RING_SIZE - off : n;
+        memcpy(ring + off, p, chunk);
+        head += chunk;
+        p += chunk;
+        n -= chunk;
+    }
+}
+
+void bcast_end_frame() {
+    if (frame_is_key) {
+        keyframe_pos = frame_start;
+        have_keyframe = 1;
+    }
+    committed = head;
+}
+
+void bcast_force_keyframe() {
+    force_key = 1;
+}
+
+int bcast_pollfds(struct pollfd *fds) {
+    int n = 0;
+    if (listen_fd < 0) return 0;
+    
+    fds[n++] = (struct pollfd){ listen_fd, POLLIN, 0 };
+    for (int i = 0; i < viewer_count; i++) {
+        if (viewers[i].pos < committed) {
+            fds[n++] = (struct pollfd){ viewers[i].fd, POLLOUT, 0 };
+        }
+    }
+    return n;
+}
+
+// 尽量把这个观众落下的数据发出去，连接断开时返回 0
+static int pump_viewer(Viewer *v) {
+    // 要读的数据已经被覆盖：跳到最近的关键帧，关键帧会先清屏
+    if (head - v->pos > BCAST_RING_SIZE) {
+        v->pos = keyframe_pos;
+    }
+    
+    while (v->pos < committed) {
+        size_t off = v->pos % BCAST_RING_SIZE;
+        size_t len = committed - v->pos;
+        if (len > BCAST_RING_SIZE - off) {
+            len = BCAST_RING_SIZE - off;
+        }
+        ssize_t w = send(v->fd, ring + off, len, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (w < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        }
+        v->pos += w;
+    }
+    return 1;
+}
+
+void bcast_service() {
+    if (listen_fd < 0) return;
+    
+    // 新观众从最近的关键帧开始；还没有关键帧时等第一帧
+    int fd;
+    while ((fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+        if (viewer_count == BCAST_MAX_VIEWERS) {
+            close(fd);
+            continue;
+        }
+        shutdown(fd, SHUT_RD);
+        viewers[viewer_count].fd = fd;
+        viewers[viewer_count].pos = have_keyframe ? keyframe_pos : committed;
+        viewer_count++;
+    }
+    
+    for (int i = 0; i < viewer_count; ) {
+        if (!pump_viewer(&viewers[i])) {
+            close(viewers[i].fd);
+            viewers[i] = viewers[--viewer_count];
+            continue;
+        }
+        i++;
+    }
+}
@@ -0,0 +1,41 @@
+#ifndef BROADCAST_H
+#define BROADCAST_H
+
+#include <poll.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// 直播：把玩家终端的每一帧变化编码成 ANSI 字节流，推给连到 Unix 域套接字上的观众
+//   plane --broadcast /tmp/plane-watch.sock
+//   socat -u UNIX-CONNECT:/tmp/plane-watch.sock -      观众，只看不操作
+//
+// 所有帧按顺序追加到一个共享的环形缓冲区，每帧只编码一次；每个观众只记一个读到哪里的位置，
+// 直接从环形缓冲区 send 出去，不复制。套接字是非阻塞的，写不动就下次再写，游戏循环从不等观众
+// 每隔一段时间插一个关键帧（清屏 + 整屏内容）：新观众从最近的关键帧开始看，
+// 落后太多、要读的数据已经被覆盖的观众也跳到最近的关键帧
+
+#define BCAST_RING_SIZE (1 << 20)
+#define BCAST_MAX_VIEWERS 64
+#define BCAST_KEYFRAME_US 2000000  // 关键帧间隔
+
+// 开始监听，失败返回 0
+int bcast_open(const char *path);
+void bcast_close();
+int bcast_active();
+
+// 一帧的开始和结束，中间用 bcast_write 追加编码好的字节
+// bcast_begin_frame 返回 1 表示这一帧要写成关键帧（整屏），否则只写变化的部分
+int bcast_begin_frame();
+void bcast_write(const void *data, size_t n);
+void bcast_end_frame();
+
+// 下一帧强制写成关键帧，终端大小变化时用
+void bcast_force_keyframe();
+
+// 把监听套接字和还有数据没写完的观众填进 fds，返回个数
+int bcast_pollfds(struct pollfd *fds);
+
+// poll 之后调用：接受新观众，给每个观众尽量多写一些
+void bcast_service();
+
+#endif
@@ -0,0 +1,581 @@
+#include <stdlib.h>
+#include <string.h>
+#include "game.h"
+#include "house.h"
+
+const GameRules default_rules = {
+    .check_interval = 15,
+    .spawn_chance = 30,
+    .parent_time = 50,
+    .catch_distance = 3,
+    .win_time = 100,
+    .max_npcs = 2,
+};
+
+static void spawn_parent(GameContext *g);
+static void npc_remove(NpcStore *n, int i);
+static void npc_rebuild_grid(NpcStore *n);
+
+// 东亚宽字符（中日韩文字、假名、全角符号）占两列
+int glyph_width(uint32_t cp) {
+    if ((cp >= 0x1100 && cp <= 0x115f) || (cp >= 0x2e80 && cp <= 0x303e) ||
+        (cp >= 0x3041 && cp <= 0x33ff) || (cp >= 0x3400 && cp <= 0x4dbf) ||
+        (cp >= 0x4e00 && cp <= 0x9fff) || (cp >= 0xa000 && cp <= 0xa4cf) ||
+        (cp >= 0xac00 && cp <= 0xd7a3) || (cp >= 0xf900 && cp <= 0xfaff) ||
+        (cp >= 0xfe30 && cp <= 0xfe4f) || (cp >= 0xff00 && cp <= 0xff60) ||
+        (cp >= 0xffe0 && cp <= 0xffe6) || (cp >= 0x20000 && cp <= 0x3fffd)) {
+        return 2;
+    }
+    return 1;
+}
+
+// 解码一个 UTF-8 字符，返回占用的字节数；非法字节当作 '?'
+int utf8_decode(const char *s, uint32_t *cp) {
+    const unsigned char *p = (const unsigned char *)s;
+    int len;
+    
+    if (p[0] < 0x80) {
+        *cp = p[0];
+        return 1;
+    } else if ((p[0] & 0xe0) == 0xc0) {
+        *cp = p[0] & 0x1f;
+        len = 2;
+    } else if ((p[0] & 0xf0) == 0xe0) {
+        *cp = p[0] & 0x0f;
+        len = 3;
+    } else if ((p[0] & 0xf8) == 0xf0) {
+        *cp = p[0] & 0x07;
+        len = 4;
+    } else {
+        *cp = '?';
+        return 1;
+    }
+    
+    for (int i = 1; i < len; i++) {
+        if ((p[i] & 0xc0) != 0x80) {
+            *cp = '?';
+            return i;
+        }
+        *cp = (*cp << 6) | (p[i] & 0x3f);
+    }
+    return len;
+}
+
+// 编译地图：UTF-8 文本行 -> 按显示列排列的格子数组
+void map_compile(GameMap *map, const char *const rows[], int nrows, const uint8_t *zones, int width) {
+    MapCell *cells = malloc(width * nrows * sizeof(MapCell));
+    map->width = width;
+    map->height = nrows;
+    map->cells = cells;
+    
+    for (int y = 0; y < nrows; y++) {
+        MapCell *row = &cells[y * width];
+        const char *p = rows[y];
+        int x = 0;
+        
+        while (x < width) {
+            uint32_t cp = ' ';
+            if (*p) {
+                p += utf8_decode(p, &cp);
+            }
+            int w = glyph_width(cp);
+            if (x + w > width) {
+                cp = ' ';  // 宽字符放不下最后一列
+                w = 1;
+            }
+            
+            row[x].glyph = cp;
+            row[x].width = (uint8_t)w;
+            row[x].cls = cp == '#' ? CELL_WALL : cp == ' ' ? CELL_FLOOR : CELL_DECOR;
+            
+            // 墙上不算任何区域
+            for (int k = 0; k < w; k++) {
+                uint8_t z = zones ? zones[y * width + x + k] : 0;
+                row[x + k].zones = row[x].cls == CELL_WALL ? ZONE_WALL : z & ~ZONE_WALL;
+            }
+            
+            // 颜色对：墙 > 床 > 隐藏区域 > 普通文字，宽字符按第一格算
+            if (row[x].cls == CELL_WALL) {
+                row[x].pair = COLOR_PAIR_WALL;
+            } else if (row[x].zones & ZONE_BED) {
+                row[x].pair = COLOR_PAIR_BED;
+            } else if (row[x].zones & ZONE_HIDE) {
+                row[x].pair = COLOR_PAIR_HIDE;
+            } else {
+                row[x].pair = COLOR_PAIR_TEXT;
+            }
+            
+            if (w == 2) {
+                uint8_t z = row[x + 1].zones;
+                row[x + 1] = row[x];
+                row[x + 1].glyph = 0;
+                row[x + 1].width = 0;
+                row[x + 1].zones = z;
+            }
+            x += w;
+        }
+    }
+}
+
+// 导航距离场：从目标格子出发做广度优先搜索，墙不可通过
+void map_build_nav(GameMap *map) {
+    int w = map->width;
+    int n = map->width * map->height;
+    int *queue = malloc(n * sizeof(int));
+    
+    if (!map->nav) {
+        map->nav = malloc(map_nav_bytes(map->width, map->height));
+    }
+    for (int f = 0; f < NAV_COUNT; f++) {
+        uint16_t *dist = map->nav + (size_t)f * n;
+        int head = 0, tail = 0;
+        
+        for (int i = 0; i < n; i++) {
+            dist[i] = NAV_UNREACHABLE;
+        }
+        
+        // 起点：所有门，或者床 / 隐藏区域里能走的格子
+        if (f == NAV_DOOR) {
+            for (int d = 0; d < map->door_count; d++) {
+                int i = map->doors[d].y * w + map->doors[d].x;
+                if (dist[i] != 0) {
+                    dist[i] = 0;
+                    queue[tail++] = i;
+                }
+            }
+        } else {
+            int zone = f == NAV_BED ? ZONE_BED : ZONE_HIDE;
+            for (int i = 0; i < n; i++) {
+                if (map->cells[i].zones & zone) {
+                    dist[i] = 0;
+                    queue[tail++] = i;
+                }
+            }
+        }
+        
+        while (head < tail) {
+            int i = queue[head++];
+            int x = i % w, y = i / w;
+            int next[4][2] = { { x, y - 1 }, { x, y + 1 }, { x - 1, y }, { x + 1, y } };
+            for (int k = 0; k < 4; k++) {
+                int j = next[k][1] * w + next[k][0];
+                if (map_walkable(map, next[k][0], next[k][1]) && dist[j] == NAV_UNREACHABLE) {
+                    dist[j] = dist[i] + 1 < NAV_UNREACHABLE ? dist[i] + 1 : NAV_UNREACHABLE - 1;
+                    queue[tail++] = j;
+                }
+            }
+        }
+    }
+    free(queue);
+}
+
+// 两格之间的直线 (Bresenham) 中间有没有墙，两端不算
+static int line_clear(const GameMap *map, int x0, int y0, int x1, int y1) {
+    int dx = abs(x1 - x0), sx = x0 < x1 ? 1 : -1;
+    int dy = -abs(y1 - y0), sy = y0 < y1 ? 1 : -1;
+    int err = dx + dy;
+    
+    while (1) {
+        int e2 = 2 * err;
+        if (e2 >= dy) {
+            err += dy;
+            x0 += sx;
+        }
+        if (e2 <= dx) {
+            err += dx;
+            y0 += sy;
+        }
+        if (x0 == x1 && y0 == y1) return 1;
+        if (map_cell(map, x0, y0)->cls == CELL_WALL) return 0;
+    }
+}
+
+// 视野位图：两个方向的直线有一条没被墙挡住就算看得见，这样视线是对称的
+void map_build_vision(GameMap *map) {
+    if (!map->vis) {
+        map->vis = malloc(map_vis_bytes(map->width, map->height));
+    }
+    map_update_vision(map, 0, 0, map->width, map->height);
+}
+
+static inline void vis_set(GameMap *map, int x, int y, int dx, int dy) {
+    uint64_t *v = &map->vis[((size_t)y * map->width + x) * VIS_WORDS];
+    int bit = (dy + VIS_RADIUS) * VIS_SPAN + dx + VIS_RADIUS;
+    v[bit >> 6] |= 1ULL << (bit & 63);
+}
+
+// 视线对称，两端都在矩形里的一对格子只算一次（从上面那个、同一行时从左边那个算），两边的位一起设上
+void map_update_vision(GameMap *map, int x0, int y0, int x1, int y1) {
+    for (int y = y0; y < y1; y++) {
+        memset(&map->vis[((size_t)y * map->width + x0) * VIS_WORDS], 0,
+               (size_t)(x1 - x0) * VIS_WORDS * sizeof(uint64_t));
+    }
+    
+    for (int y = y0; y < y1; y++) {
+        for (int x = x0; x < x1; x++) {
+            if (!map_walkable(map, x, y)) continue;
+            
+            vis_set(map, x, y, 0, 0);
+            for (int dy = -VIS_RADIUS; dy <= VIS_RADIUS; dy++) {
+                for (int dx = -VIS_RADIUS; dx <= VIS_RADIUS; dx++) {
+                    int tx = x + dx, ty = y + dy;
+                    int forward = dy > 0 || (dy == 0 && dx > 0);
+                    int inside = tx >= x0 && tx < x1 && ty >= y0 && ty < y1;
+                    if ((dx == 0 && dy == 0) || (inside && !forward) || !map_walkable(map, tx, ty)) continue;
+                    
+                    if (line_clear(map, x, y, tx, ty) || line_clear(map, tx, ty, x, y)) {
+                        vis_set(map, x, y, dx, dy);
+                        if (inside) {
+                            vis_set(map, tx, ty, -dx, -dy);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+// 在四个相邻格子里找离目标最近的一个，先上下后左右
+GameInput nav_step(const GameMap *map, NavField f, int x, int y) {
+    static const int dx[4] = { 0, 0, -1, 1 };
+    static const int dy[4] = { -1, 1, 0, 0 };
+    static const GameInput dir[4] = { INPUT_UP, INPUT_DOWN, INPUT_LEFT, INPUT_RIGHT };
+    int best = nav_dist(map, f, x, y);
+    GameInput in = INPUT_NONE;
+    
+    for (int k = 0; k < 4; k++) {
+        int nx = x + dx[k], ny = y + dy[k];
+        if (map_walkable(map, nx, ny) && nav_dist(map, f, nx, ny) < best) {
+            best = nav_dist(map, f, nx, ny);
+            in = dir[k];
+        }
+    }
+    return in;
+}
+
+// 用 splitmix64 把一个种子展开成发生器状态
+void rng_seed(GameRng *r, uint64_t seed) {
+    for (int i = 0; i < 4; i++) {
+        uint64_t z = (seed += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        r->s[i] = z ^ (z >> 31);
+    }
+}
+
+static inline uint64_t rotl(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+uint64_t rng_next(GameRng *r) {
+    uint64_t *s = r->s;
+    uint64_t result = rotl(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+    
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl(s[3], 45);
+    
+    return result;
+}
+
+// 取高32位乘以 n，避免取模的偏差和除法
+int rng_range(GameRng *r, int n) {
+    return (int)(((rng_next(r) >> 32) * (uint64_t)n) >> 32);
+}
+
+// 初始化游戏
+int game_init(GameContext *g, MapType map, const GameRules *rules, uint64_t seed) {
+    const GameMap *m = map_get(map);
+    if (!m) return 0;
+    return game_init_map(g, m, rules, seed);
+}
+
+int game_init_map(GameContext *g, const GameMap *m, const GameRules *rules, uint64_t seed) {
+    g->map_type = m->type;
+    g->map = m;
+    g->rules = rules ? *rules : default_rules;
+    g->seed = seed;
+    rng_seed(&g->rng, seed);
+    
+    g->player.x = g->map->spawn_x;
+    g->player.y = g->map->spawn_y;
+    g->player.score = 0;
+    g->player.time_played = 0;
+    g->player.state = PLAYING_PLANE;
+    
+    // 房间里没有别人
+    g->npcs.count = 0;
+    g->npcs.free_count = 0;
+    g->npcs.next_id = 0;
+    memset(g->npcs.bin_head, 0xff, sizeof(g->npcs.bin_head));  // 全部为 NPC_NONE
+    
+    g->game_time = 0;
+    g->total_time = 0;
+    g->parent_check_timer = 0;
+    g->warning_timer = 0;
+    g->state = PLAYING;
+    return 1;
+}
+
+// 窗口挪动以后平移所有坐标，落到窗口外面的家人就当作离开了
+static void shift_world(GameContext *g, int dx, int dy) {
+    NpcStore *n = &g->npcs;
+    
+    g->player.x -= dx;
+    g->player.y -= dy;
+    for (int i = 0; i < n->count; ) {
+        int x = n->x[i] - dx, y = n->y[i] - dy;
+        if (!map_walkable(g->map, x, y)) {
+            npc_remove(n, i);
+            continue;
+        }
+        n->x[i] = (int16_t)x;
+        n->y[i] = (int16_t)y;
+        i++;
+    }
+    npc_rebuild_grid(n);
+}
+
+// 移动玩家
+void game_input(GameContext *g, GameInput in) {
+    if (g->state != PLAYING) return;
+    
+    int new_x = g->player.x;
+    int new_y = g->player.y;
+    
+    switch (in) {
+        case INPUT_UP:    new_y--; break;
+        case INPUT_DOWN:  new_y++; break;
+        case INPUT_LEFT:  new_x--; break;
+        case INPUT_RIGHT: new_x++; break;
+        case INPUT_NONE:  return;
+    }
+    
+    // 检查边界和墙壁
+    if (map_walkable(g->map, new_x, new_y)) {
+        g->player.x = new_x;
+        g->player.y = new_y;
+    }
+    
+    int dx, dy;
+    if (g->map->house && house_follow(g->map->house, g->player.x, g->player.y, &dx, &dy)) {
+        shift_world(g, dx, dy);
+    }
+}
+
+// 更新游戏逻辑
+void update_game(GameContext *g) {
+    if (g->state != PLAYING) return;
+    
+    Player *player = &g->player;
+    
+    g->game_time++;
+    
+    if (g->warning_timer > 0) {
+        g->warning_timer--;
+    }
+    
+    // 每10秒增加游戏时间
+    if (g->game_time % 10 == 0) {
+        g->total_time++;
+        player->score += 10;
+        
+        // 检查胜利条件
+        if (g->total_time >= g->rules.win_time) {
+            g->state = WIN;
+            return;
+        }
+    }
+    
+    // 更新父母检查计时器
+    g->parent_check_timer++;
+    if (g->parent_check_timer >= g->rules.check_interval) {  // 每隔一段时间父母可能来检查
+        if (rng_range(&g->rng, 100) < g->rules.spawn_chance) {  // 按概率触发检查
+            spawn_parent(g);
+            g->warning_timer = 20;  // 显示警告2秒
+        }
+        g->parent_check_timer = 0;
+    }
+    
+    // 移动家人
+    move_npcs(g);
+    
+    // 检查碰撞
+    check_collisions(g);
+    
+    // 检查玩家是否在正确位置
+    int hiding = in_hide_area(g->map, player->x, player->y);
+    
+    // 如果有人在房间里，玩家应该在隐藏区域
+    if (g->npcs.count > 0) {
+        if (hiding) {
+            player->state = HIDING;
+            player->score += 5;  // 成功躲避加分
+        } else {
+            player->state = PLAYING_PLANE;
+        }
+    } else {
+        // 检查是否在床上玩飞机
+        if (in_bed_area(g->map, player->x, player->y)) {
+            player->state = PLAYING_PLANE;
+            player->score += 2;  // 在床上玩飞机加分
+        } else {
+            player->state = HIDING;
+        }
+    }
+}
+
+// 执行操作后推进一个模拟步
+void game_step(GameContext *g, GameInput in) {
+    game_input(g, in);
+    update_game(g);
+}
+
+// 生成一个家人：从随机一扇门进来，先去床边看看
+int npc_spawn(GameContext *g, NpcKind kind) {
+    NpcStore *n = &g->npcs;
+    int limit = g->rules.max_npcs < MAX_NPCS ? g->rules.max_npcs : MAX_NPCS;
+    if (n->count >= limit) return -1;
+    
+    const MapPoint *door = &g->map->doors[rng_range(&g->rng, g->map->door_count)];
+    int id = n->free_count > 0 ? n->free_ids[--n->free_count] : n->next_id++;
+    int i = n->count++;
+    
+    n->x[i] = (int16_t)door->x;
+    n->y[i] = (int16_t)door->y;
+    n->timer[i] = g->rules.parent_time;  // 停留时间
+    n->target[i] = NAV_BED;
+    n->kind[i] = (uint8_t)kind;
+    n->id[i] = (uint16_t)id;
+    n->index[id] = (uint16_t)i;
+    return id;
+}
+
+// 检查时间到了：平时只有父母，家庭聚会时谁都可能来
+static void spawn_parent(GameContext *g) {
+    NpcKind kind = NPC_PARENT;
+    if (g->rules.max_npcs > 2) {
+        kind = (NpcKind)rng_range(&g->rng, NPC_KIND_COUNT);
+    }
+    npc_spawn(g, kind);
+}
+
+// 空间网格的桶坐标散列到固定个数的链表
+static inline int npc_bin(int bx, int by) {
+    return (int)(((uint32_t)bx * 0x9e3779b1u ^ (uint32_t)by * 0x85ebca6bu) >> 24) & (NPC_GRID_BINS - 1);
+}
+
+// 按当前位置重建空间网格
+static void npc_rebuild_grid(NpcStore *n) {
+    for (int b = 0; b < NPC_GRID_BINS; b++) {
+        n->bin_head[b] = NPC_NONE;
+    }
+    for (int i = 0; i < n->count; i++) {
+        int b = npc_bin(n->x[i] >> NPC_GRID_SHIFT, n->y[i] >> NPC_GRID_SHIFT);
+        n->bin_next[i] = n->bin_head[b];
+        n->bin_head[b] = (uint16_t)i;
+    }
+}
+
+void npc_reindex(NpcStore *n) {
+    for (int i = 0; i < n->count; i++) {
+        n->index[n->id[i]] = (uint16_t)i;
+    }
+    npc_rebuild_grid(n);
+}
+
+// 删除第 i 个实体：最后一个搬过来填空，编号放回空闲表
+static void npc_remove(NpcStore *n, int i) {
+    int last = --n->count;
+    n->free_ids[n->free_count++] = n->id[i];
+    if (i != last) {
+        n->x[i] = n->x[last];
+        n->y[i] = n->y[last];
+        n->timer[i] = n->timer[last];
+        n->target[i] = n->target[last];
+        n->kind[i] = n->kind[last];
+        n->id[i] = n->id[last];
+        n->index[n->id[i]] = (uint16_t)i;
+    }
+}
+
+// 移动家人：沿距离场走，每步只看四个相邻格子
+void move_npcs(GameContext *g) {
+    const GameMap *map = g->map;
+    NpcStore *n = &g->npcs;
+    
+    for (int i = 0; i < n->count; ) {
+        if (--n->timer[i] <= 0) {
+            npc_remove(n, i);
+            continue;  // 最后一个搬到了 i，重新处理这个位置
+        }
+        
+        int x = n->x[i], y = n->y[i];
+        int target = n->target[i];
+        
+        // 剩下的时间只够走回门口了
+        if (target != NAV_DOOR && n->timer[i] <= nav_dist(map, NAV_DOOR, x, y)) {
+            target = NAV_DOOR;
+        }
+        
+        // 到了目标：在门口就离开，否则在床和隐藏区域之间来回巡查
+        if (nav_dist(map, target, x, y) == 0) {
+            if (target == NAV_DOOR) {
+                npc_remove(n, i);
+                continue;
+            }
+            target = target == NAV_BED ? NAV_HIDE : NAV_BED;
+        }
+        n->target[i] = (uint8_t)target;
+        
+        // 老人两步才走一格
+        if (n->kind[i] == NPC_GRANDPARENT && (n->timer[i] & 1)) {
+            i++;
+            continue;
+        }
+        
+        switch (nav_step(map, target, x, y)) {
+            case INPUT_UP:    n->y[i]--; break;
+            case INPUT_DOWN:  n->y[i]++; break;
+            case INPUT_LEFT:  n->x[i]--; break;
+            case INPUT_RIGHT: n->x[i]++; break;
+            case INPUT_NONE:  break;  // 目标走不到，原地不动
+        }
+        i++;
+    }
+    npc_rebuild_grid(n);
+}
+
+// 检查碰撞
+void check_collisions(GameContext *g) {
+    // 玩家在隐藏区域就不会被发现
+    if (in_hide_area(g->map, g->player.x, g->player.y)) return;
+    
+    const GameMap *map = g->map;
+    const NpcStore *n = &g->npcs;
+    int px = g->player.x, py = g->player.y;
+    int reach = g->rules.catch_distance < VIS_RADIUS ? g->rules.catch_distance : VIS_RADIUS;
+    if (reach < 0 || n->count == 0) return;
+    
+    // 只看玩家附近的几个桶：有人离得够近，中间又没有墙挡着，就被抓到
+    int bx0 = (px - reach > 0 ? px - reach : 0) >> NPC_GRID_SHIFT;
+    int by0 = (py - reach > 0 ? py - reach : 0) >> NPC_GRID_SHIFT;
+    int bx1 = (px + reach) >> NPC_GRID_SHIFT;
+    int by1 = (py + reach) >> NPC_GRID_SHIFT;
+    for (int by = by0; by <= by1; by++) {
+        for (int bx = bx0; bx <= bx1; bx++) {
+            for (int i = n->bin_head[npc_bin(bx, by)]; i != NPC_NONE; i = n->bin_next[i]) {
+                int dx = n->x[i] - px, dy = n->y[i] - py;
+                if (abs(dx) + abs(dy) <= reach && map_sees(map, px, py, dx, dy)) {
+                    g->player.state = CAUGHT;
+                    g->state = LOST;
+                    return;
+                }
+            }
+        }
+    }
+}
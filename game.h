@@ -0,0 +1,291 @@
+#ifndef GAME_H
+#define GAME_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// 游戏核心：不依赖终端，所有状态都在 GameContext 里
+// 交互界面 (plane.c) 和批量模拟 (sim.c) 都链接这一部分
+
+// 游戏状态枚举
+typedef enum {
+    MENU,
+    PLAYING,
+    PAUSED,
+    WIN,
+    LOST,
+    MAP_SELECTION
+} GameState;
+
+// 地图编号：地图包里的第几张地图，前三张是内置地图
+typedef enum {
+    EUROPE_US,
+    VIENNA_HOTEL,
+    JAPAN
+} MapType;
+
+// 玩家状态枚举
+typedef enum {
+    PLAYING_PLANE,
+    HIDING,
+    CAUGHT
+} PlayerState;
+
+// 玩家操作，每个模拟步最多一个
+typedef enum {
+    INPUT_NONE,
+    INPUT_UP,
+    INPUT_DOWN,
+    INPUT_LEFT,
+    INPUT_RIGHT
+} GameInput;
+
+// 结构体定义
+typedef struct {
+    int x, y;
+    int score;
+    int time_played;
+    PlayerState state;
+} Player;
+
+// 家里的其他人，都会来查房
+typedef enum {
+    NPC_PARENT,
+    NPC_SIBLING,
+    NPC_GRANDPARENT,  // 走得慢，两步走一格
+    NPC_PET,
+    NPC_KIND_COUNT
+} NpcKind;
+
+#define MAX_NPCS 512
+
+// 空间网格：8x8 格一个桶，桶按坐标散列到固定个数的链表里，每步移动后重建
+#define NPC_GRID_SHIFT 3
+#define NPC_GRID_BINS 256
+#define NPC_NONE 0xffff
+
+// 实体存储：按列存放，活跃的实体紧挨着排在前 count 个位置，每个系统一遍扫过去
+// 删除时把最后一个搬到空位；id 是稳定编号，离开的实体的编号放进空闲表重复使用
+// 没有指针，整个结构可以直接复制
+typedef struct {
+    int count;
+    int16_t x[MAX_NPCS], y[MAX_NPCS];
+    int32_t timer[MAX_NPCS];      // 剩余停留步数
+    uint8_t target[MAX_NPCS];     // 正在去的地方 (NavField)
+    uint8_t kind[MAX_NPCS];       // NpcKind
+    uint16_t id[MAX_NPCS];        // 第 i 个活跃实体的编号
+    uint16_t index[MAX_NPCS];     // 编号 -> 在数组里的位置
+    uint16_t free_ids[MAX_NPCS];
+    int free_count;
+    int next_id;                  // 还没用过的最小编号
+    uint16_t bin_head[NPC_GRID_BINS];  // 每个散列桶里第一个实体的位置，NPC_NONE 表示空
+    uint16_t bin_next[MAX_NPCS];       // 同一个桶里的下一个实体
+} NpcStore;
+
+// 颜色对定义（地图格子里直接记录颜色对，界面不用再逐格判断）
+#define COLOR_PAIR_PLAYER 1
+#define COLOR_PAIR_PARENT 2
+#define COLOR_PAIR_BED 3
+#define COLOR_PAIR_HIDE 4
+#define COLOR_PAIR_WALL 5
+#define COLOR_PAIR_TEXT 6
+#define COLOR_PAIR_WARNING 7
+#define COLOR_PAIR_MENU 8
+
+// 地图格子类别
+typedef enum {
+    CELL_FLOOR,  // 空地
+    CELL_WALL,   // 墙，不能走
+    CELL_DECOR   // 家具和文字，可以走
+} CellClass;
+
+// 格子所在的区域 (MapCell.zones)，编译地图时算好，判断只要读一次掩码
+// 低4位是标志，高4位是隐藏区域的编号 (1-15)，一张地图可以有多个任意形状的隐藏区域
+#define ZONE_BED 0x01
+#define ZONE_HIDE 0x02
+#define ZONE_WALL 0x04
+#define ZONE_DOOR 0x08
+#define ZONE_HIDE_ID(z) ((z) >> 4)
+#define MAX_HIDE_ZONES 15
+
+// 地图的一格（按显示列计算）
+// 宽字符占两格：第一格记录字形，第二格 glyph 为 0、width 为 0
+typedef struct {
+    uint32_t glyph;   // Unicode 码点
+    uint8_t width;    // 显示宽度
+    uint8_t cls;      // CellClass
+    uint8_t pair;     // 颜色对
+    uint8_t zones;    // ZONE_* 掩码
+} MapCell;
+
+typedef struct {
+    int32_t x, y;
+} MapPoint;
+
+// 导航距离场：每个格子到目标的最短步数，每张地图算一次，所有父母共用
+typedef enum {
+    NAV_DOOR,   // 最近的门
+    NAV_BED,    // 床
+    NAV_HIDE,   // 隐藏区域
+    NAV_COUNT
+} NavField;
+
+#define NAV_UNREACHABLE 0xffff
+
+// 视野：每个格子一张位图，记录以它为中心 VIS_SPAN x VIS_SPAN 范围内哪些格子看得见（中间没有墙挡住）
+// 视线是对称的，A 看得见 B 当且仅当 B 看得见 A
+#define VIS_RADIUS 7
+#define VIS_SPAN (2 * VIS_RADIUS + 1)
+#define VIS_WORDS ((VIS_SPAN * VIS_SPAN + 63) / 64)
+
+typedef struct {
+    MapType type;
+    int width, height;
+    const MapCell *cells;   // width * height 个格子，按行连续存放
+    int hide_count;         // 隐藏区域个数
+    int spawn_x, spawn_y;   // 玩家出生点
+    int door_count;
+    const MapPoint *doors;  // 父母进门的位置
+    const char *map_name;
+    const char *map_id;     // ASCII 标识，如 EUROPE_US
+    const char *hint;       // 躲藏提示，如 "学习区"
+    uint16_t *nav;          // NAV_COUNT 个距离场，每个 width * height，打开地图时由 map_build_nav 算出
+    uint64_t *vis;          // 每格 VIS_WORDS 个字的视野位图，打开地图时由 map_build_vision 算出
+    struct House *house;    // 整栋房子模式下地图是房子里的一块窗口 (house.h)，其他地图为 NULL
+} GameMap;
+
+// 随机数发生器 (xoshiro256**)，每局一个，不共享全局状态
+typedef struct {
+    uint64_t s[4];
+} GameRng;
+
+// 影响胜负概率的平衡参数
+typedef struct {
+    int check_interval;  // 每隔多少步父母可能来检查
+    int spawn_chance;    // 检查时父母出现的概率（百分比）
+    int parent_time;     // 父母停留的步数
+    int catch_distance;  // 父母发现玩家的曼哈顿距离，还要看得见（最远 VIS_RADIUS）
+    int win_time;        // 坚持多少秒胜利
+    int max_npcs;        // 同时在房间里的人数上限，大于2时是家庭聚会模式，兄弟姐妹、老人和宠物也会来
+} GameRules;
+
+extern const GameRules default_rules;
+
+// 一局游戏的全部状态
+typedef struct {
+    GameState state;
+    MapType map_type;
+    const GameMap *map;
+    GameRules rules;
+    uint64_t seed;      // 开局种子，录像和成绩记录用
+    GameRng rng;
+    Player player;
+    NpcStore npcs;
+    int game_time;
+    int total_time;
+    int parent_check_timer;
+    int warning_timer;
+} GameContext;
+
+// 地图数据来自地图包 (mapfile.h)，所有对局共享
+extern int map_count;
+
+// 第 i 张地图，编号越界或地图包里的数据损坏时返回 NULL
+const GameMap *map_get(int i);
+
+// 把 UTF-8 文本行编译成格子数组，宽度不足的行用空格补齐
+// zones 是每格的区域掩码（width * nrows 个，可以为 NULL），墙由字形决定，颜色对在这里一并算出
+// 格子数组用 malloc 分配，由调用者释放
+void map_compile(GameMap *map, const char *const rows[], int nrows, const uint8_t *zones, int width);
+
+// 导航距离场和视野位图占多少字节
+static inline size_t map_nav_bytes(int width, int height) {
+    return (size_t)NAV_COUNT * width * height * sizeof(uint16_t);
+}
+
+static inline size_t map_vis_bytes(int width, int height) {
+    return (size_t)width * height * VIS_WORDS * sizeof(uint64_t);
+}
+
+// 在可走的格子上做广度优先搜索，算出所有导航距离场
+// map->nav 不为 NULL 时直接写进去（至少 map_nav_bytes 字节，地图包和整栋房子自己管这块内存），
+// 为 NULL 时用 malloc 分配，由调用者释放；map_build_vision 对 map->vis 也一样
+void map_build_nav(GameMap *map);
+
+static inline int nav_dist(const GameMap *map, NavField f, int x, int y) {
+    return map->nav[(size_t)f * map->width * map->height + y * map->width + x];
+}
+
+// 算出每个格子的视野位图
+void map_build_vision(GameMap *map);
+
+// 只重新算矩形 [x0, x1) x [y0, y1) 里的格子的视野位图，地图的一部分变了以后用
+void map_update_vision(GameMap *map, int x0, int y0, int x1, int y1);
+
+// 从 (x, y) 能不能看见 (x + dx, y + dy)，|dx| 和 |dy| 都不能超过 VIS_RADIUS
+static inline int map_sees(const GameMap *map, int x, int y, int dx, int dy) {
+    const uint64_t *v = &map->vis[((size_t)y * map->width + x) * VIS_WORDS];
+    int bit = (dy + VIS_RADIUS) * VIS_SPAN + dx + VIS_RADIUS;
+    return (v[bit >> 6] >> (bit & 63)) & 1;
+}
+
+// 沿距离场往目标走一步的方向，已经到达或走不到时返回 INPUT_NONE
+GameInput nav_step(const GameMap *map, NavField f, int x, int y);
+
+// 字符的显示宽度（东亚宽字符为2）
+int glyph_width(uint32_t cp);
+
+// 解码一个 UTF-8 字符，返回占用的字节数；非法字节当作 '?'
+int utf8_decode(const char *s, uint32_t *cp);
+
+static inline const MapCell *map_cell(const GameMap *map, int x, int y) {
+    return &map->cells[y * map->width + x];
+}
+
+// 越界或是墙都不能走
+static inline int map_walkable(const GameMap *map, int x, int y) {
+    return x >= 0 && x < map->width && y >= 0 && y < map->height &&
+           map->cells[y * map->width + x].cls != CELL_WALL;
+}
+
+void rng_seed(GameRng *r, uint64_t seed);
+uint64_t rng_next(GameRng *r);
+int rng_range(GameRng *r, int n);  // [0, n)
+
+// 在指定地图上开始新的一局，rules 为 NULL 时使用默认参数
+// 相同的 seed 和输入序列总会得到相同的结果；地图不可用时返回 0
+int game_init(GameContext *g, MapType map, const GameRules *rules, uint64_t seed);
+
+// 在给定的地图上开始新的一局，整栋房子模式用（地图不在地图包里）
+int game_init_map(GameContext *g, const GameMap *map, const GameRules *rules, uint64_t seed);
+
+// 立即执行一个玩家操作（不推进时间）
+// 整栋房子模式下玩家走出窗口中间那块时，窗口跟过去，所有坐标一起平移
+void game_input(GameContext *g, GameInput in);
+
+// 推进一个模拟步
+void update_game(GameContext *g);
+
+// 执行操作后推进一个模拟步，批量模拟用
+void game_step(GameContext *g, GameInput in);
+
+// 让一个家人从门口进来，人数已满时返回 -1，否则返回编号
+int npc_spawn(GameContext *g, NpcKind kind);
+
+// 直接改了实体数组以后（比如恢复快照）调用，按 id 和位置重建编号索引和空间网格
+void npc_reindex(NpcStore *n);
+
+// update_game 的两个主要部分，单独公开给性能基准分别计时
+void move_npcs(GameContext *g);
+void check_collisions(GameContext *g);
+
+// 玩家是否在隐藏区域 / 床上区域，坐标必须在地图内
+static inline int in_hide_area(const GameMap *map, int x, int y) {
+    return map_cell(map, x, y)->zones & ZONE_HIDE;
+}
+
+static inline int in_bed_area(const GameMap *map, int x, int y) {
+    return map_cell(map, x, y)->zones & ZONE_BED;
+}
+
+#endif
@@ -0,0 +1,373 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "house.h"
+
+#define CW HOUSE_CHUNK_W
+#define CH HOUSE_CHUNK_H
+#define WIN_W (HOUSE_WINDOW * CW)
+#define WIN_H (HOUSE_WINDOW * CH)
+
+// 一块的格局：竖隔墙把块分成左右两间，其中一间可能再横着分成两间
+// 相邻块的门口要避开这里的隔墙，所以格局单独算，不用生成整块
+typedef struct {
+    int sx;      // 竖隔墙的列
+    int split;   // 0 不再分，1 左边那间横着分，2 右边那间横着分
+    int sy;      // 横隔墙的行
+} ChunkPlan;
+
+static const char *const hide_names[] = { "衣柜", "书桌", "沙发", "窗帘" };
+static const char *const other_names[] = { "餐桌", "书架", "鞋柜", "钢琴" };
+
+// 每块一个随机数发生器，只由房子的种子和块坐标决定
+static void chunk_plan(const House *h, int cx, int cy, ChunkPlan *p, GameRng *r) {
+    uint64_t key = (uint64_t)(uint32_t)cx << 32 | (uint32_t)cy;
+    rng_seed(r, h->seed ^ key * 0x9e3779b97f4a7c15ULL);
+    p->sx = 16 + rng_range(r, 16);
+    p->split = rng_range(r, 3);
+    p->sy = 8 + rng_range(r, CH - 16);
+}
+
+static int neighbor_plan(const House *h, int cx, int cy, ChunkPlan *p) {
+    GameRng r;
+    if (cx < 0 || cy < 0 || cx >= h->chunks_x || cy >= h->chunks_y) return 0;
+    chunk_plan(h, cx, cy, p, &r);
+    return 1;
+}
+
+// 在 [lo, hi] 里随机选一个位置，使 [v, v + len) 前后各留一格都不碰到 a 和 b（-1 表示不用避开）
+static int pick_gap(GameRng *r, int lo, int hi, int len, int a, int b) {
+    int v = lo;
+    for (int tries = 0; tries < 32; tries++) {
+        v = lo + rng_range(r, hi - lo + 1);
+        if ((a < 0 || a < v - 1 || a > v + len) && (b < 0 || b < v - 1 || b > v + len)) break;
+    }
+    return v;
+}
+
+static void put_glyph(uint32_t g[CH][CW], int x, int y, uint32_t cp) {
+    g[y][x] = cp;
+    if (glyph_width(cp) == 2) {
+        g[y][x + 1] = 0;  // 续格，编码成 UTF-8 时跳过
+    }
+}
+
+static void put_text(uint32_t g[CH][CW], int x, int y, const char *s) {
+    while (*s) {
+        uint32_t cp;
+        s += utf8_decode(s, &cp);
+        put_glyph(g, x, y, cp);
+        x += glyph_width(cp);
+    }
+}
+
+static void fill_zone(uint8_t *zones, int x0, int y0, int x1, int y1, uint8_t z) {
+    for (int y = y0; y <= y1; y++) {
+        for (int x = x0; x <= x1; x++) {
+            zones[y * CW + x] |= z;
+        }
+    }
+}
+
+static int utf8_encode(uint32_t cp, char *out) {
+    if (cp < 0x80) {
+        out[0] = (char)cp;
+        return 1;
+    } else if (cp < 0x800) {
+        out[0] = (char)(0xc0 | cp >> 6);
+        out[1] = (char)(0x80 | (cp & 0x3f));
+        return 2;
+    } else if (cp < 0x10000) {
+        out[0] = (char)(0xe0 | cp >> 12);
+        out[1] = (char)(0x80 | (cp >> 6 & 0x3f));
+        out[2] = (char)(0x80 | (cp & 0x3f));
+        return 3;
+    }
+    out[0] = (char)(0xf0 | cp >> 18);
+    out[1] = (char)(0x80 | (cp >> 12 & 0x3f));
+    out[2] = (char)(0x80 | (cp >> 6 & 0x3f));
+    out[3] = (char)(0x80 | (cp & 0x3f));
+    return 4;
+}
+
+// 生成一块：先画出字形和区域图，再和文本地图一样用 map_compile 编译成格子
+static void chunk_generate(const House *h, HouseChunk *c, int cx, int cy) {
+    uint32_t g[CH][CW];
+    uint8_t zones[CH * CW];
+    char text[CH][CW * 4 + 1];
+    GameRng r;
+    ChunkPlan p, left, up;
+    
+    chunk_plan(h, cx, cy, &p, &r);
+    int has_left = neighbor_plan(h, cx - 1, cy, &left);
+    int has_up = neighbor_plan(h, cx, cy - 1, &up);
+    
+    for (int y = 0; y < CH; y++) {
+        for (int x = 0; x < CW; x++) {
+            int wall = x == 0 || y == 0 || x == p.sx ||
+                       (x == CW - 1 && cx == h->chunks_x - 1) || (y == CH - 1 && cy == h->chunks_y - 1) ||
+                       (y == p.sy && p.split == 1 && x < p.sx) || (y == p.sy && p.split == 2 && x > p.sx);
+            g[y][x] = wall ? '#' : ' ';
+        }
+    }
+    memset(zones, 0, sizeof(zones));
+    
+    // 竖隔墙上的门口两格高，横隔墙上的三格宽，都不能正对着另一道隔墙
+    int vy = pick_gap(&r, 2, CH - 4, 2, p.split ? p.sy : -1, -1);
+    g[vy][p.sx] = g[vy + 1][p.sx] = ' ';
+    if (p.split) {
+        int lo = p.split == 1 ? 2 : p.sx + 2;
+        int hi = p.split == 1 ? p.sx - 5 : CW - 5;
+        int hx = lo + rng_range(&r, hi - lo + 1);
+        g[p.sy][hx] = g[p.sy][hx + 1] = g[p.sy][hx + 2] = ' ';
+    }
+    
+    // 通向左边和上边相邻块的门口，两边房间里的隔墙都要避开
+    c->doors[0] = c->doors[1] = (MapPoint){ -1, -1 };
+    int ly = pick_gap(&r, 2, CH - 4, 2, p.split == 1 ? p.sy : -1,
+                      has_left && left.split == 2 ? left.sy : -1);
+    int tx = pick_gap(&r, 2, CW - 5, 3, p.sx, has_up ? up.sx : -1);
+    if (cx > 0) {
+        g[ly][0] = g[ly + 1][0] = ' ';
+        zones[ly * CW] |= ZONE_DOOR;
+        c->doors[0] = (MapPoint){ 0, ly };
+    }
+    if (cy > 0) {
+        g[0][tx] = g[0][tx + 1] = g[0][tx + 2] = ' ';
+        zones[tx + 1] |= ZONE_DOOR;
+        c->doors[1] = (MapPoint){ tx + 1, 0 };
+    }
+    
+    // 房间（内部的矩形），每块两三间
+    int rooms[3][4];
+    int n = 0;
+    int right_x1 = cx == h->chunks_x - 1 ? CW - 2 : CW - 1;
+    int bottom_y1 = cy == h->chunks_y - 1 ? CH - 2 : CH - 1;
+    if (p.split == 1) {
+        memcpy(rooms[n++], (int[4]){ 1, 1, p.sx - 1, p.sy - 1 }, sizeof(rooms[0]));
+        memcpy(rooms[n++], (int[4]){ 1, p.sy + 1, p.sx - 1, bottom_y1 }, sizeof(rooms[0]));
+    } else {
+        memcpy(rooms[n++], (int[4]){ 1, 1, p.sx - 1, bottom_y1 }, sizeof(rooms[0]));
+    }
+    if (p.split == 2) {
+        memcpy(rooms[n++], (int[4]){ p.sx + 1, 1, right_x1, p.sy - 1 }, sizeof(rooms[0]));
+        memcpy(rooms[n++], (int[4]){ p.sx + 1, p.sy + 1, right_x1, bottom_y1 }, sizeof(rooms[0]));
+    } else {
+        memcpy(rooms[n++], (int[4]){ p.sx + 1, 1, right_x1, bottom_y1 }, sizeof(rooms[0]));
+    }
+    
+    // 一间放床，另一间放能躲的家具，剩下的一间放普通家具
+    int bed = rng_range(&r, n);
+    int hide = (bed + 1 + rng_range(&r, n - 1)) % n;
+    for (int i = 0; i < n; i++) {
+        int mx = (rooms[i][0] + rooms[i][2]) / 2;
+        int my = (rooms[i][1] + rooms[i][3]) / 2;
+        if (i == bed) {
+            put_glyph(g, mx - 1, my - 1, 0x5e8a);  // 床
+            put_text(g, mx - 1, my, "[=]");
+            fill_zone(zones, mx - 1, my - 1, mx + 1, my + 1, ZONE_BED);
+            c->bed_x = mx;
+            c->bed_y = my;
+        } else if (i == hide) {
+            put_text(g, mx - 2, my, hide_names[rng_range(&r, 4)]);
+            fill_zone(zones, mx - 3, my - 1, mx + 2, my + 1, ZONE_HIDE | (i + 1) << 4);
+        } else {
+            put_text(g, mx - 2, my, other_names[rng_range(&r, 4)]);
+        }
+    }
+    
+    const char *rows[CH];
+    for (int y = 0; y < CH; y++) {
+        int len = 0;
+        for (int x = 0; x < CW; x++) {
+            if (g[y][x] != 0) {
+                len += utf8_encode(g[y][x], &text[y][len]);
+            }
+        }
+        text[y][len] = 0;
+        rows[y] = text[y];
+    }
+    
+    GameMap tmp;
+    map_compile(&tmp, rows, CH, zones, CW);
+    memcpy(c->cells, tmp.cells, sizeof(c->cells));
+    free((void *)tmp.cells);
+    
+    c->cx = cx;
+    c->cy = cy;
+}
+
+// 取一块：在缓存里就直接用，否则生成并放进最久没用的位置；房子外面返回 NULL
+static HouseChunk *house_chunk(House *h, int cx, int cy) {
+    if (cx < 0 || cy < 0 || cx >= h->chunks_x || cy >= h->chunks_y) return NULL;
+    
+    HouseChunk *slot = NULL;
+    for (int i = 0; i < HOUSE_CACHE; i++) {
+        HouseChunk *c = &h->cache[i];
+        if (c->cx == cx && c->cy == cy) {
+            c->last_used = ++h->clock;
+            return c;
+        }
+        if (!slot || (slot->cx >= 0 && (c->cx < 0 || c->last_used < slot->last_used))) {
+            slot = c;
+        }
+    }
+    
+    if (slot->cx < 0) {
+        h->cached++;
+    }
+    chunk_generate(h, slot, cx, cy);
+    slot->last_used = ++h->clock;
+    h->generated++;
+    return slot;
+}
+
+// 视野位图记录的是相对位置，窗口挪动以后还在窗口里的格子的位图可以直接平移过来：
+// 新窗口的 (x, y) 取旧窗口的 (x + sdx, y + sdy)
+static void shift_vision(GameMap *m, int sdx, int sdy) {
+    int xs = sdx > 0 ? 0 : -sdx;
+    size_t n = (size_t)(m->width - abs(sdx)) * VIS_WORDS * sizeof(uint64_t);
+    
+    for (int k = 0; k < m->height - abs(sdy); k++) {
+        int y = sdy >= 0 ? k : m->height - 1 - k;  // 往哪边挪就从哪边开始拷，不会覆盖还没拷的行
+        memmove(&m->vis[((size_t)y * m->width + xs) * VIS_WORDS],
+                &m->vis[((size_t)(y + sdy) * m->width + xs + sdx) * VIS_WORDS], n);
+    }
+}
+
+// 平移以后要重算的：新进来的那一条，以及离窗口边不到 VIS_RADIUS 的格子（它们看到的范围变了）
+static void update_vision(GameMap *m, int sdx, int sdy) {
+    int w = m->width, h = m->height, r = VIS_RADIUS;
+    
+    if (sdx > 0) {
+        map_update_vision(m, w - sdx - r, 0, w, h);
+        map_update_vision(m, 0, 0, r, h);
+    } else if (sdx < 0) {
+        map_update_vision(m, 0, 0, -sdx + r, h);
+        map_update_vision(m, w - r, 0, w, h);
+    }
+    if (sdy > 0) {
+        map_update_vision(m, 0, h - sdy - r, w, h);
+        map_update_vision(m, 0, 0, w, r);
+    } else if (sdy < 0) {
+        map_update_vision(m, 0, 0, w, -sdy + r);
+        map_update_vision(m, 0, h - r, w, h);
+    }
+}
+
+// 把窗口放到以 (ocx, ocy) 为左上角的 3x3 块上，重新算导航距离场和视野
+static void build_window(House *h, int ocx, int ocy) {
+    static const MapCell outside = { ' ', 1, CELL_WALL, COLOR_PAIR_WALL, ZONE_WALL };
+    GameMap *m = &h->window;
+    int mid_x = ocx + HOUSE_WINDOW / 2, mid_y = ocy + HOUSE_WINDOW / 2;
+    int sdx = (ocx - h->org_cx) * CW, sdy = (ocy - h->org_cy) * CH;
+    
+    h->org_cx = ocx;
+    h->org_cy = ocy;
+    
+    // 离得太远的块不会马上再用到，先丢掉
+    for (int i = 0; i < HOUSE_CACHE; i++) {
+        HouseChunk *c = &h->cache[i];
+        if (c->cx >= 0 && (abs(c->cx - mid_x) > HOUSE_KEEP || abs(c->cy - mid_y) > HOUSE_KEEP)) {
+            c->cx = -1;
+            h->cached--;
+        }
+    }
+    
+    for (int wy = 0; wy < HOUSE_WINDOW; wy++) {
+        for (int wx = 0; wx < HOUSE_WINDOW; wx++) {
+            const HouseChunk *c = house_chunk(h, ocx + wx, ocy + wy);
+            for (int y = 0; y < CH; y++) {
+                MapCell *dst = &h->cells[(wy * CH + y) * WIN_W + wx * CW];
+                if (c) {
+                    memcpy(dst, &c->cells[y * CW], CW * sizeof(MapCell));
+                } else {
+                    for (int x = 0; x < CW; x++) {
+                        dst[x] = outside;
+                    }
+                }
+            }
+        }
+    }
+    
+    // 家人从中间那块四周的门口进来：它自己左边和上边的门口，加上右边和下边相邻块的
+    const HouseChunk *mid = house_chunk(h, mid_x, mid_y);
+    const HouseChunk *right = house_chunk(h, mid_x + 1, mid_y);
+    const HouseChunk *down = house_chunk(h, mid_x, mid_y + 1);
+    int bx = (HOUSE_WINDOW / 2) * CW, by = (HOUSE_WINDOW / 2) * CH;
+    int n = 0;
+    for (int k = 0; k < 2; k++) {
+        if (mid->doors[k].x >= 0) {
+            h->doors[n++] = (MapPoint){ bx + mid->doors[k].x, by + mid->doors[k].y };
+        }
+    }
+    if (right && right->doors[0].x >= 0) {
+        h->doors[n++] = (MapPoint){ bx + CW + right->doors[0].x, by + right->doors[0].y };
+    }
+    if (down && down->doors[1].x >= 0) {
+        h->doors[n++] = (MapPoint){ bx + down->doors[1].x, by + CH + down->doors[1].y };
+    }
+    
+    m->type = MAP_HOUSE;
+    m->width = WIN_W;
+    m->height = WIN_H;
+    m->cells = h->cells;
+    m->hide_count = 3;
+    m->spawn_x = bx + mid->bed_x;
+    m->spawn_y = by + mid->bed_y;
+    m->door_count = n;
+    m->doors = h->doors;
+    m->map_name = "整栋房子";
+    m->map_id = "HOUSE";
+    m->hint = "衣柜、书桌等家具";
+    m->house = h;
+    m->nav = h->nav;
+    m->vis = h->vis;
+    
+    map_build_nav(m);
+    
+    // 挪动一块时大约三分之一的位图要重算，第一次建窗口时全算
+    if (h->vis_ready && abs(sdx) < WIN_W && abs(sdy) < WIN_H) {
+        shift_vision(m, sdx, sdy);
+        update_vision(m, sdx, sdy);
+    } else {
+        map_build_vision(m);
+        h->vis_ready = 1;
+    }
+}
+
+House *house_new(uint64_t seed, int width, int height) {
+    House *h = calloc(1, sizeof(House));
+    h->seed = seed;
+    h->chunks_x = width / CW > 2 ? width / CW : 2;
+    h->chunks_y = height / CH > 2 ? height / CH : 2;
+    for (int i = 0; i < HOUSE_CACHE; i++) {
+        h->cache[i].cx = -1;
+    }
+    build_window(h, h->chunks_x / 2 - HOUSE_WINDOW / 2, h->chunks_y / 2 - HOUSE_WINDOW / 2);
+    return h;
+}
+
+void house_free(House *h) {
+    free(h);
+}
+
+int house_follow(House *h, int x, int y, int *dx, int *dy) {
+    // 相对中间那块左上角的坐标，还在中间那块（加上余量）里面就不用换
+    int lx = x - (HOUSE_WINDOW / 2) * CW, ly = y - (HOUSE_WINDOW / 2) * CH;
+    if (lx >= -HOUSE_MARGIN && lx < CW + HOUSE_MARGIN && ly >= -HOUSE_MARGIN && ly < CH + HOUSE_MARGIN) {
+        return 0;
+    }
+    
+    int ocx = h->org_cx + x / CW - HOUSE_WINDOW / 2;
+    int ocy = h->org_cy + y / CH - HOUSE_WINDOW / 2;
+    *dx = (ocx - h->org_cx) * CW;
+    *dy = (ocy - h->org_cy) * CH;
+    build_window(h, ocx, ocy);
+    return 1;
+}
+
+void house_goto(House *h, int ocx, int ocy) {
+    if (ocx == h->org_cx && ocy == h->org_cy) return;
+    build_window(h, ocx, ocy);
+}
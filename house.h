@@ -0,0 +1,76 @@
+#ifndef HOUSE_H
+#define HOUSE_H
+
+#include <stdint.h>
+
+#include "game.h"
+
+// 整栋房子：按种子随机生成的大房子，可以有几千 x 几千格，由很多房间组成
+// 房子切成 HOUSE_CHUNK_W x HOUSE_CHUNK_H 的块，每块只由种子和块坐标决定，用到时才生成，
+// 生成好的块放在一个固定大小的缓存里，满了丢掉最久没用的，换窗口时离玩家太远的也丢掉
+//
+// 游戏逻辑看到的地图是玩家周围 3x3 块的窗口 (House.window)，是一张普通的 GameMap，
+// 导航距离场和视野只对窗口计算。玩家走出中间那一块时窗口整块挪过去，
+// 玩家和家人的坐标跟着平移（game_input 里做），所以内存和每步的开销都与房子大小无关
+//
+// 每块的左边和上边是墙，上面各有一个通向相邻块的门口；块里面用一两道有门口的隔墙分成两三个房间，
+// 每块都有一张床和一个能躲的地方。家人从窗口中间那一块四周的门口进来
+
+#define HOUSE_CHUNK_W 48
+#define HOUSE_CHUNK_H 24
+#define HOUSE_WINDOW 3        // 窗口是 HOUSE_WINDOW x HOUSE_WINDOW 块
+#define HOUSE_CACHE 64        // 最多缓存多少块
+#define HOUSE_KEEP 3          // 换窗口时，离中间那块超过这么多块的缓存丢掉
+#define HOUSE_MARGIN 8        // 玩家走出中间那块这么多格才换窗口，来回走不会反复换
+
+// 地图编号里表示整栋房子
+#define MAP_HOUSE ((MapType)-1)
+
+typedef struct {
+    int cx, cy;             // 块坐标，cx 为 -1 表示空位
+    uint32_t last_used;
+    int bed_x, bed_y;       // 床的中心，块内坐标
+    MapPoint doors[2];      // 左边和上边墙上的门口，块内坐标；房子最外圈的墙上没有门
+    int door_count;
+    MapCell cells[HOUSE_CHUNK_W * HOUSE_CHUNK_H];
+} HouseChunk;
+
+typedef struct House {
+    uint64_t seed;
+    int chunks_x, chunks_y;     // 房子有多少块
+    int org_cx, org_cy;         // 窗口左上角那一块的块坐标，可以在房子外面（按墙处理）
+    uint32_t clock;
+    int generated;              // 一共生成过多少块
+    int cached;                 // 缓存里现在有多少块
+    HouseChunk cache[HOUSE_CACHE];
+
+    // 窗口的格子、导航距离场和视野都放在这个结构体里，整栋房子只有一次分配
+    GameMap window;
+    MapCell cells[HOUSE_WINDOW * HOUSE_CHUNK_W * HOUSE_WINDOW * HOUSE_CHUNK_H];
+    uint16_t nav[NAV_COUNT * HOUSE_WINDOW * HOUSE_CHUNK_W * HOUSE_WINDOW * HOUSE_CHUNK_H];
+    uint64_t vis[HOUSE_WINDOW * HOUSE_CHUNK_W * HOUSE_WINDOW * HOUSE_CHUNK_H * VIS_WORDS];
+    int vis_ready;              // 视野算过一次以后，挪动窗口时只算变了的部分
+    MapPoint doors[4];
+} House;
+
+// 生成一栋 width x height 格的房子（按块取整，至少 2x2 块），窗口放在房子正中间那一块
+House *house_new(uint64_t seed, int width, int height);
+void house_free(House *h);
+
+// 玩家走到窗口坐标 (x, y) 以后调用：走出中间那一块时把窗口挪到玩家所在的块，
+// 重新算导航距离场和视野，返回 1 并在 dx, dy 里给出所有坐标要减去的偏移量
+int house_follow(House *h, int x, int y, int *dx, int *dy);
+
+// 把窗口直接放到以 (ocx, ocy) 为左上角的块上（恢复快照用），已经在那里时什么也不做
+void house_goto(House *h, int ocx, int ocy);
+
+// 窗口坐标换算成房子里的绝对坐标
+static inline int house_abs_x(const House *h, int x) {
+    return h->org_cx * HOUSE_CHUNK_W + x;
+}
+
+static inline int house_abs_y(const House *h, int y) {
+    return h->org_cy * HOUSE_CHUNK_H + y;
+}
+
+#endif
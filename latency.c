@@ -0,0 +1,692 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <locale.h>
+#include <poll.h>
+#include <pty.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include <wchar.h>
+
+// 按键延迟测试：在伪终端里运行 plane，按时间表发按键，解析它的输出，测从按键到画面变化的时间
+// 输出用一个简单的终端模拟器解析（光标移动、清屏、颜色等 ncurses 和 --ansi 后端用到的控制序列），
+// 玩家是屏幕上绿色的 A/S/X，菜单和暂停靠屏幕上的文字判断
+//
+// 用法: latency [--plane ./plane] [-n 轮数] [--seed N] [--max-p99 毫秒] [--json] [-- plane 的其他参数]
+//
+// 场景（每个场景 n 轮，两次按键之间随机隔 20-70 毫秒，避开渲染和模拟步的节拍）：
+//   menu   菜单按 1 进地图选择、按 M 回菜单，到界面换掉为止
+//   move   一次按一个方向键，到玩家挪到下一格为止，接着按反方向回来
+//   burst  一次写进去一串同方向的按键（不撞墙的最多 4 格），到玩家走到终点为止；
+//          中间每一格都该画出来，没画出来的记为合并 (coalesced)
+//   pause  空格暂停、再按空格继续，到暂停提示出现/消失为止
+// 等了 1 秒画面还没变的按键记为丢失 (dropped)
+// 游戏用 --family 0 跑，没有家人来查房，玩家不会被抓
+//
+// 每个场景一行：样本数、延迟的 p50/p90/p99/最大值（毫秒）、丢失和合并的按键数；--json 时每行一个 JSON 对象
+// 给了 --max-p99 时，任何场景的 p99 超过它或者有按键丢失就返回 1，可以当作按键处理的回归检查
+
+#define ROWS 40
+#define COLS 120
+#define TIMEOUT_NS 1000000000LL
+#define MAX_SAMPLES 4096
+#define PLAYER_COLOR 2   // COLOR_GREEN
+
+typedef struct {
+    wchar_t ch;
+    int fg;              // 前景色，-1 是默认颜色
+} VtCell;
+
+// 终端模拟器
+typedef struct {
+    VtCell cell[ROWS][COLS];
+    int y, x, saved_y, saved_x;
+    int top, bottom;     // 滚动区域
+    int fg;
+    wchar_t last;        // REP 用
+    
+    // 解析状态
+    enum { VT_GROUND, VT_ESC, VT_CSI, VT_OSC, VT_CHARSET } state;
+    int params[16], nparams;
+    int priv;
+    unsigned utf8;       // 正在拼的 UTF-8 字符
+    int utf8_left;
+} Vt;
+
+typedef struct {
+    const char *name;
+    long long ns[MAX_SAMPLES];
+    int count;
+    int dropped;
+    int coalesced;
+} Scenario;
+
+static Vt vt;
+static int master_fd = -1;
+static pid_t child = -1;
+static unsigned long long rng_state = 0x9e3779b97f4a7c15ULL;
+
+static long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int rand_range(int lo, int hi) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return lo + (int)(rng_state % (unsigned long long)(hi - lo + 1));
+}
+
+static void vt_clear_cells(int y, int x0, int x1) {
+    for (int x = x0; x < x1 && x < COLS; x++) {
+        vt.cell[y][x].ch = L' ';
+        vt.cell[y][x].fg = -1;
+    }
+}
+
+static void vt_reset(void) {
+    memset(&vt, 0, sizeof(vt));
+    for (int y = 0; y < ROWS; y++) {
+        vt_clear_cells(y, 0, COLS);
+    }
+    vt.bottom = ROWS - 1;
+    vt.fg = -1;
+}
+
+// 滚动区域上移 n 行（内容往上走）
+static void vt_scroll_up(int top, int n) {
+    for (int k = 0; k < n; k++) {
+        memmove(vt.cell[top], vt.cell[top + 1], (vt.bottom - top) * sizeof(vt.cell[0]));
+        vt_clear_cells(vt.bottom, 0, COLS);
+    }
+}
+
+static void vt_scroll_down(int top, int n) {
+    for (int k = 0; k < n; k++) {
+        memmove(vt.cell[top + 1], vt.cell[top], (vt.bottom - top) * sizeof(vt.cell[0]));
+        vt_clear_cells(top, 0, COLS);
+    }
+}
+
+static void vt_linefeed(void) {
+    if (vt.y == vt.bottom) {
+        vt_scroll_up(vt.top, 1);
+    } else if (vt.y < ROWS - 1) {
+        vt.y++;
+    }
+}
+
+static void vt_print(wchar_t ch) {
+    int w = wcwidth(ch);
+    if (w < 1) {
+        w = 1;
+    }
+    // 上一个字符写到了最后一列，这时才换行
+    if (vt.x + w > COLS) {
+        vt.x = 0;
+        vt_linefeed();
+    }
+    vt.cell[vt.y][vt.x].ch = ch;
+    vt.cell[vt.y][vt.x].fg = vt.fg;
+    if (w == 2) {
+        vt.cell[vt.y][vt.x + 1].ch = 0;
+        vt.cell[vt.y][vt.x + 1].fg = vt.fg;
+    }
+    vt.x += w;
+    vt.last = ch;
+}
+
+static int param(int i, int def) {
+    return i < vt.nparams && vt.params[i] > 0 ? vt.params[i] : def;
+}
+
+static void vt_sgr(void) {
+    if (vt.nparams == 0) {
+        vt.fg = -1;
+    }
+    for (int i = 0; i < vt.nparams; i++) {
+        int p = vt.params[i];
+        if (p == 0 || p == 39) {
+            vt.fg = -1;
+        } else if (p >= 30 && p <= 37) {
+            vt.fg = p - 30;
+        } else if (p >= 90 && p <= 97) {
+            vt.fg = p - 90 + 8;
+        } else if (p == 38 && i + 2 < vt.nparams && vt.params[i + 1] == 5) {
+            vt.fg = vt.params[i + 2];
+            i += 2;
+        } else if (p == 48 && i + 2 < vt.nparams && vt.params[i + 1] == 5) {
+            i += 2;
+        }
+    }
+}
+
+static void vt_csi(char f) {
+    int n = param(0, 1);
+    if (vt.priv) return;  // ESC[?...h/l 之类的模式设置
+    switch (f) {
+        case 'A': vt.y -= n; break;
+        case 'B': vt.y += n; break;
+        case 'C': vt.x += n; break;
+        case 'D': vt.x -= n; break;
+        case 'E': vt.y += n; vt.x = 0; break;
+        case 'F': vt.y -= n; vt.x = 0; break;
+        case 'G': vt.x = n - 1; break;
+        case 'd': vt.y = n - 1; break;
+        case 'H':
+        case 'f':
+            vt.y = param(0, 1) - 1;
+            vt.x = param(1, 1) - 1;
+            break;
+        case 'J': {
+            int m = vt.nparams ? vt.params[0] : 0;
+            if (m == 2 || m == 3) {
+                for (int y = 0; y < ROWS; y++) {
+                    vt_clear_cells(y, 0, COLS);
+                }
+            } else if (m == 0) {
+                vt_clear_cells(vt.y, vt.x, COLS);
+                for (int y = vt.y + 1; y < ROWS; y++) {
+                    vt_clear_cells(y, 0, COLS);
+                }
+            }
+            break;
+        }
+        case 'K': {
+            int m = vt.nparams ? vt.params[0] : 0;
+            if (m == 0) {
+                vt_clear_cells(vt.y, vt.x, COLS);
+            } else if (m == 1) {
+                vt_clear_cells(vt.y, 0, vt.x + 1);
+            } else {
+                vt_clear_cells(vt.y, 0, COLS);
+            }
+            break;
+        }
+        case 'X': vt_clear_cells(vt.y, vt.x, vt.x + n); break;
+        case 'b':
+            for (int i = 0; i < n; i++) {
+                vt_print(vt.last);
+            }
+            break;
+        case '@':
+            if (n > COLS - vt.x) {
+                n = COLS - vt.x;
+            }
+            memmove(&vt.cell[vt.y][vt.x + n], &vt.cell[vt.y][vt.x], (COLS - vt.x - n) * sizeof(VtCell));
+            vt_clear_cells(vt.y, vt.x, vt.x + n);
+            break;
+        case 'P':
+            if (n > COLS - vt.x) {
+                n = COLS - vt.x;
+            }
+            memmove(&vt.cell[vt.y][vt.x], &vt.cell[vt.y][vt.x + n], (COLS - vt.x - n) * sizeof(VtCell));
+            vt_clear_cells(vt.y, COLS - n, COLS);
+            break;
+        case 'L': if (vt.y >= vt.top && vt.y <= vt.bottom) vt_scroll_down(vt.y, n); break;
+        case 'M': if (vt.y >= vt.top && vt.y <= vt.bottom) vt_scroll_up(vt.y, n); break;
+        case 'S': vt_scroll_up(vt.top, n); break;
+        case 'T': vt_scroll_down(vt.top, n); break;
+        case 'r':
+            vt.top = param(0, 1) - 1;
+            vt.bottom = param(1, ROWS) - 1;
+            vt.y = vt.x = 0;
+            break;
+        case 'm': vt_sgr(); break;
+    }
+    
+    if (vt.top < 0 || vt.bottom >= ROWS || vt.top >= vt.bottom) {
+        vt.top = 0;
+        vt.bottom = ROWS - 1;
+    }
+    vt.y = vt.y < 0 ? 0 : vt.y >= ROWS ? ROWS - 1 : vt.y;
+    vt.x = vt.x < 0 ? 0 : vt.x >= COLS ? COLS - 1 : vt.x;
+}
+
+static void vt_esc(char c) {
+    vt.state = VT_GROUND;
+    switch (c) {
+        case '[':
+            vt.state = VT_CSI;
+            vt.nparams = 0;
+            vt.priv = 0;
+            memset(vt.params, 0, sizeof(vt.params));
+            break;
+        case ']': vt.state = VT_OSC; break;
+        case '(': case ')': case '*': case '+': vt.state = VT_CHARSET; break;
+        case '7': vt.saved_y = vt.y; vt.saved_x = vt.x; break;
+        case '8': vt.y = vt.saved_y; vt.x = vt.saved_x; break;
+        case 'D': vt_linefeed(); break;
+        case 'E': vt.x = 0; vt_linefeed(); break;
+        case 'M':
+            if (vt.y == vt.top) {
+                vt_scroll_down(vt.top, 1);
+            } else if (vt.y > 0) {
+                vt.y--;
+            }
+            break;
+        case 'c': vt_reset(); break;
+    }
+}
+
+static void vt_feed(const unsigned char *p, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        unsigned char c = p[i];
+        switch (vt.state) {
+            case VT_ESC:
+                vt_esc((char)c);
+                continue;
+            case VT_CHARSET:
+                vt.state = VT_GROUND;
+                continue;
+            case VT_OSC:
+                if (c == 7 || c == '\\') {
+                    vt.state = VT_GROUND;
+                }
+                continue;
+            case VT_CSI:
+                if (c >= '0' && c <= '9') {
+                    if (vt.nparams == 0) {
+                        vt.nparams = 1;
+                    }
+                    int *v = &vt.params[vt.nparams - 1];
+                    *v = *v * 10 + (c - '0');
+                } else if (c == ';') {
+                    if (vt.nparams == 0) {
+                        vt.nparams = 1;
+                    }
+                    if (vt.nparams < 16) {
+                        vt.params[vt.nparams++] = 0;
+                    }
+                } else if (c == '?' || c == '>' || c == '=') {
+                    vt.priv = 1;
+                } else if (c >= 0x40 && c <= 0x7e) {
+                    vt.state = VT_GROUND;
+                    vt_csi((char)c);
+                }
+                continue;
+            case VT_GROUND:
+                break;
+        }
+        
+        if (vt.utf8_left > 0) {
+            if ((c & 0xc0) == 0x80) {
+                vt.utf8 = (vt.utf8 << 6) | (c & 0x3f);
+                if (--vt.utf8_left == 0) {
+                    vt_print((wchar_t)vt.utf8);
+                }
+                continue;
+            }
+            vt.utf8_left = 0;
+        }
+        if (c >= 0xc0) {
+            vt.utf8_left = c >= 0xf0 ? 3 : c >= 0xe0 ? 2 : 1;
+            vt.utf8 = c & (0x3f >> vt.utf8_left);
+        } else if (c >= 0x20 && c < 0x7f) {
+            vt_print(c);
+        } else if (c == 0x1b) {
+            vt.state = VT_ESC;
+        } else if (c == '\r') {
+            vt.x = 0;
+        } else if (c == '\n') {
+            vt_linefeed();
+        } else if (c == '\b') {
+            if (vt.x > 0) {
+                vt.x--;
+            }
+        } else if (c == '\t') {
+            vt.x = (vt.x + 8) & ~7;
+            if (vt.x >= COLS) {
+                vt.x = COLS - 1;
+            }
+        }
+    }
+}
+
+// 屏幕上有没有这段文字
+static int screen_has(const wchar_t *text) {
+    size_t n = wcslen(text);
+    for (int y = 0; y < ROWS; y++) {
+        wchar_t line[COLS + 1];
+        int k = 0;
+        for (int x = 0; x < COLS; x++) {
+            if (vt.cell[y][x].ch != 0) {
+                line[k++] = vt.cell[y][x].ch;
+            }
+        }
+        line[k] = 0;
+        if (n <= (size_t)k && wcsstr(line, text)) return 1;
+    }
+    return 0;
+}
+
+// 找绿色的玩家，找不到返回 0
+static int find_player(int *py, int *px) {
+    for (int y = 0; y < ROWS; y++) {
+        for (int x = 0; x < COLS; x++) {
+            wchar_t c = vt.cell[y][x].ch;
+            if (vt.cell[y][x].fg == PLAYER_COLOR && (c == L'A' || c == L'S' || c == L'X')) {
+                *py = y;
+                *px = x;
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+// 读 plane 的输出，直到 deadline；每读到一段就喂给终端模拟器，再调用 step，step 返回非 0 时停下
+// 返回 step 成立的时刻，超时返回 0
+static long long pump(long long deadline, int (*step)(void *), void *arg) {
+    unsigned char buf[65536];
+    for (;;) {
+        if (step && step(arg)) return now_ns();
+        long long left = deadline - now_ns();
+        if (left <= 0) return 0;
+        
+        struct pollfd p = { .fd = master_fd, .events = POLLIN };
+        int r = poll(&p, 1, (int)((left + 999999) / 1000000));
+        if (r < 0 && errno != EINTR) return 0;
+        if (r <= 0) continue;
+        ssize_t n = read(master_fd, buf, sizeof(buf));
+        if (n <= 0) return 0;  // plane 退出了
+        vt_feed(buf, (size_t)n);
+    }
+}
+
+static void send_keys(const char *keys) {
+    size_t n = strlen(keys);
+    if (write(master_fd, keys, n) != (ssize_t)n) {
+        perror("write");
+    }
+}
+
+// 按键之间随机停一会儿，同时把输出读掉
+static void pause_between(void) {
+    pump(now_ns() + rand_range(20, 70) * 1000000LL, NULL, NULL);
+}
+
+static int has_text(void *arg) {
+    return screen_has(arg);
+}
+
+static int lacks_text(void *arg) {
+    return !screen_has(arg);
+}
+
+static void add_sample(Scenario *s, long long ns) {
+    if (s->count < MAX_SAMPLES) {
+        s->ns[s->count++] = ns;
+    }
+}
+
+// 发按键，等到 cond 成立
+static void timed_key(Scenario *s, const char *keys, int (*cond)(void *), void *arg) {
+    long long t0 = now_ns();
+    send_keys(keys);
+    long long t = pump(t0 + TIMEOUT_NS, cond, arg);
+    if (t) {
+        add_sample(s, t - t0);
+    } else {
+        s->dropped++;
+    }
+}
+
+// 玩家走到 (ty, tx)，一路上记下画出来过几个不同的位置
+typedef struct {
+    int ty, tx;
+    int ly, lx;
+    int steps;
+} Walk;
+
+static int walk_step(void *arg) {
+    Walk *w = arg;
+    int y, x;
+    if (!find_player(&y, &x)) return 0;
+    if (y != w->ly || x != w->lx) {
+        w->steps++;
+        w->ly = y;
+        w->lx = x;
+    }
+    return y == w->ty && x == w->tx;
+}
+
+// 一次写进去 k 个方向键，期望玩家走 k 格到 (y + k*dy, x + k*dx)
+static void timed_walk(Scenario *s, char key, int k, int dy, int dx) {
+    char keys[8];
+    int y, x;
+    find_player(&y, &x);
+    memset(keys, key, k);
+    keys[k] = 0;
+    
+    Walk w = { y + k * dy, x + k * dx, y, x, 0 };
+    long long t0 = now_ns();
+    send_keys(keys);
+    long long t = pump(t0 + TIMEOUT_NS, walk_step, &w);
+    if (t) {
+        add_sample(s, t - t0);
+        s->coalesced += k - w.steps;
+    } else {
+        // 没走到：差几格就丢了几个
+        int moved = abs(w.ly - y) + abs(w.lx - x);
+        s->dropped += k - (moved < k ? moved : k);
+        s->coalesced += moved - w.steps > 0 ? moved - w.steps : 0;
+    }
+}
+
+static int player_moved(void *arg) {
+    int *from = arg;
+    int y, x;
+    return find_player(&y, &x) && (y != from[0] || x != from[1]);
+}
+
+// 找一个能走的方向，返回这个方向上连续能走几格（最多 4 格）；玩家最后回到原处
+static const struct { char key, back; int dy, dx; } dirs[] = {
+    { 'd', 'a', 0, 1 }, { 'a', 'd', 0, -1 }, { 's', 'w', 1, 0 }, { 'w', 's', -1, 0 },
+};
+
+static int probe_direction(int *dir) {
+    for (int d = 0; d < 4; d++) {
+        int k = 0;
+        while (k < 4) {
+            int from[2];
+            find_player(&from[0], &from[1]);
+            char key[2] = { dirs[d].key, 0 };
+            send_keys(key);
+            if (!pump(now_ns() + 300000000LL, player_moved, from)) break;
+            k++;
+        }
+        for (int i = 0; i < k; i++) {
+            int from[2];
+            find_player(&from[0], &from[1]);
+            char key[2] = { dirs[d].back, 0 };
+            send_keys(key);
+            pump(now_ns() + 300000000LL, player_moved, from);
+        }
+        if (k > 0) {
+            *dir = d;
+            return k;
+        }
+    }
+    return 0;
+}
+
+static int cmp_ll(const void *a, const void *b) {
+    long long x = *(const long long *)a, y = *(const long long *)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile_ms(const Scenario *s, int p) {
+    if (s->count == 0) return 0;
+    int i = (int)((long long)(s->count - 1) * p / 100);
+    return s->ns[i] / 1e6;
+}
+
+static void report(Scenario *s, int json) {
+    qsort(s->ns, s->count, sizeof(long long), cmp_ll);
+    double p50 = percentile_ms(s, 50), p90 = percentile_ms(s, 90), p99 = percentile_ms(s, 99);
+    double max = s->count ? s->ns[s->count - 1] / 1e6 : 0;
+    if (json) {
+        printf("{\"bench\":\"latency\",\"scenario\":\"%s\",\"samples\":%d,\"p50_ms\":%.2f,\"p90_ms\":%.2f,"
+               "\"p99_ms\":%.2f,\"max_ms\":%.2f,\"dropped\":%d,\"coalesced\":%d}\n",
+               s->name, s->count, p50, p90, p99, max, s->dropped, s->coalesced);
+    } else {
+        printf("latency %-6s %5d 次  p50 %7.2f ms  p90 %7.2f ms  p99 %7.2f ms  最大 %7.2f ms  丢失 %3d  合并 %3d\n",
+               s->name, s->count, p50, p90, p99, max, s->dropped, s->coalesced);
+    }
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "用法: %s [--plane ./plane] [-n 轮数] [--seed N] [--max-p99 毫秒] [--json] [-- plane 的其他参数]\n", prog);
+}
+
+// 在伪终端里启动 plane，终端大小固定为 ROWS x COLS
+static int spawn_plane(const char *plane, const char *seed, char **extra, int nextra) {
+    struct winsize ws = { .ws_row = ROWS, .ws_col = COLS };
+    char *args[64];
+    int n = 0;
+    args[n++] = (char *)plane;
+    args[n++] = "--seed";
+    args[n++] = (char *)seed;
+    args[n++] = "--family";
+    args[n++] = "0";
+    args[n++] = "--attract";
+    args[n++] = "0";
+    for (int i = 0; i < nextra && n < 63; i++) {
+        args[n++] = extra[i];
+    }
+    args[n] = NULL;
+    
+    child = forkpty(&master_fd, NULL, NULL, &ws);
+    if (child < 0) return 0;
+    if (child == 0) {
+        setenv("TERM", "xterm-256color", 1);
+        setenv("LANG", "C.UTF-8", 1);
+        unsetenv("LINES");
+        unsetenv("COLUMNS");
+        execv(plane, args);
+        _exit(127);
+    }
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    const char *plane = "./plane";
+    const char *seed = "1";
+    int rounds = 50;
+    int json = 0;
+    double max_p99 = 0;
+    char **extra = NULL;
+    int nextra = 0;
+    
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--plane") == 0 && i + 1 < argc) {
+            plane = argv[++i];
+        } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            rounds = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = argv[++i];
+        } else if (strcmp(argv[i], "--max-p99") == 0 && i + 1 < argc) {
+            max_p99 = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--json") == 0) {
+            json = 1;
+        } else if (strcmp(argv[i], "--") == 0) {
+            extra = argv + i + 1;
+            nextra = argc - i - 1;
+            break;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (rounds < 1) {
+        rounds = 1;
+    }
+    
+    if (!setlocale(LC_CTYPE, "C.UTF-8")) {
+        setlocale(LC_CTYPE, "");
+    }
+    vt_reset();
+    if (!spawn_plane(plane, seed, extra, nextra)) {
+        perror("forkpty");
+        return 1;
+    }
+    
+    Scenario menu = { .name = "menu" }, move = { .name = "move" }, burst = { .name = "burst" },
+             pause = { .name = "pause" };
+    int ok = 1;
+    
+    // 菜单
+    if (!pump(now_ns() + 5 * TIMEOUT_NS, has_text, L"开始游戏")) {
+        fprintf(stderr, "%s 没有显示菜单\n", plane);
+        ok = 0;
+    }
+    for (int r = 0; ok && r < rounds; r++) {
+        pause_between();
+        timed_key(&menu, "1", has_text, L"选择地图");
+        pause_between();
+        timed_key(&menu, "m", has_text, L"开始游戏");
+    }
+    
+    // 开始第一张地图
+    int dir = 0, run = 0;
+    if (ok) {
+        int y, x;
+        send_keys("1");
+        pump(now_ns() + TIMEOUT_NS, has_text, L"选择地图");
+        send_keys("1");
+        if (!pump(now_ns() + 2 * TIMEOUT_NS, player_moved, (int[]){ -1, -1 }) || !find_player(&y, &x)) {
+            fprintf(stderr, "游戏画面上找不到玩家\n");
+            ok = 0;
+        } else if (!(run = probe_direction(&dir))) {
+            fprintf(stderr, "玩家四面都走不动\n");
+            ok = 0;
+        }
+    }
+    
+    for (int r = 0; ok && r < rounds; r++) {
+        pause_between();
+        timed_walk(&move, dirs[dir].key, 1, dirs[dir].dy, dirs[dir].dx);
+        pause_between();
+        timed_walk(&move, dirs[dir].back, 1, -dirs[dir].dy, -dirs[dir].dx);
+    }
+    for (int r = 0; ok && r < rounds; r++) {
+        pause_between();
+        timed_walk(&burst, dirs[dir].key, run, dirs[dir].dy, dirs[dir].dx);
+        pause_between();
+        timed_walk(&burst, dirs[dir].back, run, -dirs[dir].dy, -dirs[dir].dx);
+    }
+    for (int r = 0; ok && r < rounds; r++) {
+        pause_between();
+        timed_key(&pause, " ", has_text, L"游戏暂停");
+        pause_between();
+        timed_key(&pause, " ", lacks_text, L"游戏暂停");
+    }
+    
+    // 退出：游戏中按 Q
+    send_keys("q");
+    pump(now_ns() + TIMEOUT_NS, NULL, NULL);
+    if (waitpid(child, NULL, WNOHANG) == 0) {
+        kill(child, SIGKILL);
+        waitpid(child, NULL, 0);
+    }
+    if (!ok) return 1;
+    
+    Scenario *all[] = { &menu, &move, &burst, &pause };
+    int pass = 1;
+    for (int i = 0; i < 4; i++) {
+        report(all[i], json);
+        if (max_p99 > 0 && (percentile_ms(all[i], 99) > max_p99 || all[i]->dropped > 0)) {
+            pass = 0;
+        }
+    }
+    return pass ? 0 : 1;
+}
@@ -0,0 +1,390 @@
+// 地图编译器：把文本地图编译成游戏直接 mmap 的地图包
+//
+// 用法: ./mapc -o maps.pack maps/europe.map maps/vienna.map maps/japan.map
+//       ./mapc -c builtin_maps.c maps/europe.map maps/vienna.map maps/japan.map
+// 地图包里地图的顺序就是命令行上的顺序，也就是地图编号
+// -c 生成内置地图的 C 源文件：格子、门、名字和预先算好的导航距离场、视野都写成 static const 数组，
+// 和游戏一起编译，启动时不用读地图包（mapfile.h 的 maps_use_builtin）
+//
+// 文本地图格式 (UTF-8):
+//   grid 之前每行一个属性，空行和以 ; 开头的行忽略
+//     id      EUROPE_US          ASCII 标识（必填）
+//     name    欧美卧室           显示名称（必填）
+//     hint    学习区             躲藏提示，显示在游戏界面右侧
+//     width   40                 地图宽度（显示列），省略时取最宽的一行
+//     bed     5 5                床的中心，床占 3x3
+//     hide    25 8 8 4           矩形隐藏区域：左上角 x y、宽、高，每行一个新的隐藏区域
+//     spawn   5 5                玩家出生点，省略时在床上
+//     door    7 1                父母进门的位置，至少一个，可以写多行
+//   grid 一行之后是地图本身，# 是墙，空格是空地，其他字符是可以走的家具和文字
+//   可选的 zones 一行之后是区域图，和地图逐列对应，每列一个 ASCII 字符：
+//     B 床，1-9 a-f 第几号隐藏区域，其他字符（空格、.）不属于任何区域
+//   用区域图可以画出任意形状的床和隐藏区域，和 bed / hide 属性可以同时使用
+//   床和隐藏区域都至少要有一格能走到
+//   坐标都从地图左上角 (0, 0) 算，按显示列计数，一个汉字占两列
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "game.h"
+#include "mapfile.h"
+
+#define MAX_DOORS 16
+
+typedef struct {
+    GameMap map;
+    MapPoint doors[MAX_DOORS];
+    char *text;     // 整个文件内容，各个字符串都指向这里
+    uint8_t *zones;
+} SourceMap;
+
+static const char *cur_path;
+static int cur_line;
+
+static void fail(const char *msg) {
+    fprintf(stderr, "%s:%d: %s\n", cur_path, cur_line, msg);
+    exit(1);
+}
+
+static char *read_file(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+    
+    size_t len = 0, cap = 4096;
+    char *buf = malloc(cap);
+    size_t n;
+    while ((n = fread(buf + len, 1, cap - len - 1, f)) > 0) {
+        len += n;
+        if (cap - len <= 1) {
+            cap *= 2;
+            buf = realloc(buf, cap);
+        }
+    }
+    fclose(f);
+    buf[len] = 0;
+    return buf;
+}
+
+// 一行的显示宽度
+static int row_width(const char *s) {
+    int w = 0;
+    while (*s) {
+        uint32_t cp;
+        s += utf8_decode(s, &cp);
+        w += glyph_width(cp);
+    }
+    return w;
+}
+
+// 读 n 个整数参数
+static void parse_ints(const char *args, int *out, int n) {
+    char *end;
+    for (int i = 0; i < n; i++) {
+        long v = strtol(args, &end, 10);
+        if (end == args || v < 0 || v > 32767) {
+            fail("需要非负整数参数");
+        }
+        out[i] = (int)v;
+        args = end;
+    }
+    while (*args == ' ' || *args == '\t') args++;
+    if (*args) {
+        fail("参数太多");
+    }
+}
+
+// 给矩形里的格子加上区域标志，超出地图的部分忽略
+static void mark_rect(uint8_t *zones, int width, int height, int x0, int y0, int w, int h, uint8_t z) {
+    for (int y = y0; y < y0 + h && y < height; y++) {
+        for (int x = x0; x < x0 + w && x < width; x++) {
+            zones[y * width + x] |= z;
+        }
+    }
+}
+
+// 区域图的一个字符对应的掩码
+static uint8_t zone_char(char c) {
+    if (c == 'B') return ZONE_BED;
+    if (c >= '1' && c <= '9') return ZONE_HIDE | (c - '0') << 4;
+    if (c >= 'a' && c <= 'f') return ZONE_HIDE | (c - 'a' + 10) << 4;
+    return 0;
+}
+
+static void parse_map(SourceMap *src, const char *path) {
+    GameMap *m = &src->map;
+    int width = 0, has_bed = 0, has_spawn = 0;
+    int bed_x = 0, bed_y = 0;
+    int hides[MAX_HIDE_ZONES][4];
+    int hide_rects = 0;
+    int v[4];
+    
+    memset(src, 0, sizeof(*src));
+    cur_path = path;
+    cur_line = 0;
+    src->text = read_file(path);
+    if (!src->text) {
+        fail("无法读取文件");
+    }
+    m->hint = "";
+    
+    // 逐行切开，行尾的 \r 一起去掉
+    char *p = src->text;
+    char **rows = NULL, **zone_rows = NULL;
+    int nrows = 0, nzones = 0, section = 0;  // 0:属性 1:grid 2:zones
+    while (*p) {
+        char *line = p;
+        char *nl = strchr(p, '\n');
+        p = nl ? nl + 1 : p + strlen(p);
+        if (nl) *nl = 0;
+        size_t len = strlen(line);
+        if (len > 0 && line[len - 1] == '\r') line[len - 1] = 0;
+        cur_line++;
+        
+        if (section == 1 && strcmp(line, "zones") == 0) {
+            section = 2;
+            continue;
+        }
+        if (section == 1) {
+            rows = realloc(rows, (nrows + 1) * sizeof(char *));
+            rows[nrows++] = line;
+            continue;
+        }
+        if (section == 2) {
+            zone_rows = realloc(zone_rows, (nzones + 1) * sizeof(char *));
+            zone_rows[nzones++] = line;
+            continue;
+        }
+        if (line[0] == 0 || line[0] == ';') continue;
+        
+        char *args = line;
+        while (*args && *args != ' ' && *args != '\t') args++;
+        if (*args) *args++ = 0;
+        while (*args == ' ' || *args == '\t') args++;
+        
+        if (strcmp(line, "grid") == 0) {
+            section = 1;
+        } else if (strcmp(line, "id") == 0) {
+            m->map_id = args;
+        } else if (strcmp(line, "name") == 0) {
+            m->map_name = args;
+        } else if (strcmp(line, "hint") == 0) {
+            m->hint = args;
+        } else if (strcmp(line, "width") == 0) {
+            parse_ints(args, &width, 1);
+        } else if (strcmp(line, "bed") == 0) {
+            parse_ints(args, v, 2);
+            bed_x = v[0];
+            bed_y = v[1];
+            has_bed = 1;
+        } else if (strcmp(line, "hide") == 0) {
+            if (hide_rects == MAX_HIDE_ZONES) {
+                fail("隐藏区域太多");
+            }
+            parse_ints(args, hides[hide_rects++], 4);
+        } else if (strcmp(line, "spawn") == 0) {
+            parse_ints(args, v, 2);
+            m->spawn_x = v[0];
+            m->spawn_y = v[1];
+            has_spawn = 1;
+        } else if (strcmp(line, "door") == 0) {
+            if (m->door_count == MAX_DOORS) {
+                fail("门太多");
+            }
+            parse_ints(args, v, 2);
+            src->doors[m->door_count].x = v[0];
+            src->doors[m->door_count].y = v[1];
+            m->door_count++;
+        } else {
+            fail("未知属性");
+        }
+    }
+    
+    // 去掉地图末尾的空行
+    while (nrows > 0 && rows[nrows - 1][0] == 0) nrows--;
+    if (nrows == 0) fail("缺少 grid");
+    if (!m->map_id || !m->map_id[0]) fail("缺少 id");
+    if (!m->map_name || !m->map_name[0]) fail("缺少 name");
+    if (m->door_count == 0) fail("缺少 door");
+    if (!has_spawn) {
+        if (!has_bed) fail("没有 bed 时必须写 spawn");
+        m->spawn_x = bed_x;
+        m->spawn_y = bed_y;
+    }
+    if (width == 0) {
+        for (int y = 0; y < nrows; y++) {
+            int w = row_width(rows[y]);
+            if (w > width) width = w;
+        }
+    }
+    if (width > 65535 || nrows > 65535) fail("地图太大");
+    if (nzones > nrows) fail("区域图比地图高");
+    
+    // 区域掩码：bed / hide 属性、区域图、门
+    uint8_t *zones = calloc((size_t)width * nrows, 1);
+    if (has_bed) {
+        mark_rect(zones, width, nrows, bed_x - 1, bed_y - 1, 3, 3, ZONE_BED);
+    }
+    for (int i = 0; i < hide_rects; i++) {
+        mark_rect(zones, width, nrows, hides[i][0], hides[i][1], hides[i][2], hides[i][3],
+                  ZONE_HIDE | (i + 1) << 4);
+    }
+    for (int y = 0; y < nzones; y++) {
+        for (int x = 0; zone_rows[y][x] && x < width; x++) {
+            uint8_t z = zone_char(zone_rows[y][x]);
+            if (z & ZONE_HIDE) {
+                zones[y * width + x] &= 0x0f;  // 区域图里的编号优先
+            }
+            zones[y * width + x] |= z;
+        }
+    }
+    for (int i = 0; i < m->door_count; i++) {
+        if (src->doors[i].x < width && src->doors[i].y < nrows) {
+            zones[src->doors[i].y * width + src->doors[i].x] |= ZONE_DOOR;
+        }
+    }
+    
+    m->doors = src->doors;
+    map_compile(m, (const char *const *)rows, nrows, zones, width);
+    src->zones = zones;
+    free(rows);
+    free(zone_rows);
+    
+    // 出生点和门必须能走到，床和每个隐藏区域至少有一格能走
+    if (!map_walkable(m, m->spawn_x, m->spawn_y)) fail("出生点在墙里或地图外");
+    for (int i = 0; i < m->door_count; i++) {
+        if (!map_walkable(m, src->doors[i].x, src->doors[i].y)) fail("门在墙里或地图外");
+    }
+    int bed_cells = 0;
+    int hide_used[MAX_HIDE_ZONES + 1] = { 0 };
+    for (int i = 0; i < m->width * m->height; i++) {
+        uint8_t z = m->cells[i].zones;
+        bed_cells += (z & ZONE_BED) != 0;
+        if (z & ZONE_HIDE) {
+            hide_used[ZONE_HIDE_ID(z)] = 1;
+        }
+    }
+    if (bed_cells == 0) fail("床不在地图里能走的地方");
+    for (int id = 1; id <= MAX_HIDE_ZONES; id++) {
+        m->hide_count += hide_used[id];
+    }
+    if (m->hide_count == 0) fail("没有能走到的隐藏区域");
+}
+
+// 字符串写成 C 字面量，非 ASCII 字节用八进制转义（十六进制转义会吞掉后面的数字和字母）
+static void write_string(FILE *f, const char *s) {
+    fputc('"', f);
+    for (const unsigned char *p = (const unsigned char *)s; *p; p++) {
+        if (*p == '"' || *p == '\\') {
+            fprintf(f, "\\%c", *p);
+        } else if (*p < 0x20 || *p >= 0x7f) {
+            fprintf(f, "\\%03o", *p);
+        } else {
+            fputc(*p, f);
+        }
+    }
+    fputc('"', f);
+}
+
+// 生成内置地图的 C 源文件，导航距离场和视野在这里算好，数据都是 static const 的
+static int write_source(const char *path, const GameMap *list, int n) {
+    FILE *f = fopen(path, "w");
+    if (!f) return 0;
+    
+    fprintf(f, "// 由 mapc -c 生成，不要手改\n\n#include \"mapfile.h\"\n");
+    for (int i = 0; i < n; i++) {
+        GameMap m = list[i];
+        int cells = m.width * m.height;
+        m.nav = NULL;
+        m.vis = NULL;
+        map_build_nav(&m);
+        map_build_vision(&m);
+        
+        fprintf(f, "\n// %s\nstatic const MapCell cells_%d[%d] = {\n", m.map_id, i, cells);
+        for (int c = 0; c < cells; c++) {
+            const MapCell *mc = &m.cells[c];
+            fprintf(f, "%s{ %u, %u, %u, %u, %u },%s", c % m.width == 0 ? "    " : "", mc->glyph, mc->width,
+                    mc->cls, mc->pair, mc->zones, c % m.width == m.width - 1 ? "\n" : " ");
+        }
+        fprintf(f, "};\n\nstatic const MapPoint doors_%d[%d] = {", i, m.door_count);
+        for (int d = 0; d < m.door_count; d++) {
+            fprintf(f, " { %d, %d },", m.doors[d].x, m.doors[d].y);
+        }
+        fprintf(f, " };\n\nstatic const uint16_t nav_%d[%d] = {\n", i, NAV_COUNT * cells);
+        for (int k = 0; k < NAV_COUNT * cells; k++) {
+            fprintf(f, "%s%u,%s", k % m.width == 0 ? "    " : "", m.nav[k], k % m.width == m.width - 1 ? "\n" : " ");
+        }
+        fprintf(f, "};\n\nstatic const uint64_t vis_%d[%d] = {\n", i, cells * VIS_WORDS);
+        for (int k = 0; k < cells * VIS_WORDS; k++) {
+            fprintf(f, "%s0x%llxu,%s", k % VIS_WORDS == 0 ? "    " : "", (unsigned long long)m.vis[k],
+                    k % VIS_WORDS == VIS_WORDS - 1 ? "\n" : " ");
+        }
+        fprintf(f, "};\n");
+        free(m.nav);
+        free(m.vis);
+    }
+    
+    // 导航和视野在游戏里只读，GameMap 的这两个指针不是 const 是因为整栋房子要改写自己的那份
+    fprintf(f, "\nconst GameMap builtin_maps[] = {\n");
+    for (int i = 0; i < n; i++) {
+        const GameMap *m = &list[i];
+        fprintf(f, "    { .type = (MapType)%d, .width = %d, .height = %d, .cells = cells_%d, .hide_count = %d,\n"
+                   "      .spawn_x = %d, .spawn_y = %d, .door_count = %d, .doors = doors_%d,\n      .map_name = ",
+                i, m->width, m->height, i, m->hide_count, m->spawn_x, m->spawn_y, m->door_count, i);
+        write_string(f, m->map_name);
+        fprintf(f, ", .map_id = ");
+        write_string(f, m->map_id);
+        fprintf(f, ", .hint = ");
+        write_string(f, m->hint);
+        fprintf(f, ",\n      .nav = (uint16_t *)nav_%d, .vis = (uint64_t *)vis_%d },\n", i, i);
+    }
+    fprintf(f, "};\n\nconst int builtin_map_count = %d;\n", n);
+    return fclose(f) == 0;
+}
+
+int main(int argc, char *argv[]) {
+    const char *out = NULL, *source = NULL;
+    const char **inputs = calloc(argc, sizeof(char *));
+    int count = 0;
+    
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            out = argv[++i];
+        } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            source = argv[++i];
+        } else {
+            inputs[count++] = argv[i];
+        }
+    }
+    if ((!out && !source) || count == 0) {
+        fprintf(stderr, "用法: %s [-o 地图包] [-c 内置地图.c] 文本地图...\n", argv[0]);
+        return 2;
+    }
+    
+    SourceMap *src = calloc(count, sizeof(SourceMap));
+    GameMap *list = calloc(count, sizeof(GameMap));
+    for (int i = 0; i < count; i++) {
+        parse_map(&src[i], inputs[i]);
+        list[i] = src[i].map;
+        list[i].type = (MapType)i;
+    }
+    
+    if (out && !mappack_write(out, list, count)) {
+        fprintf(stderr, "无法写入 %s\n", out);
+        return 1;
+    }
+    if (source && !write_source(source, list, count)) {
+        fprintf(stderr, "无法写入 %s\n", source);
+        return 1;
+    }
+    
+    for (int i = 0; i < count; i++) {
+        free((void *)src[i].map.cells);
+        free(src[i].zones);
+        free(src[i].text);
+    }
+    free(src);
+    free(list);
+    free(inputs);
+    return 0;
+}
@@ -0,0 +1,256 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mapfile.h"
+
+int map_count = 0;
+
+static const unsigned char *pack = NULL;
+static size_t pack_size = 0;
+static const MapPackEntry *pack_dir = NULL;
+static GameMap *views = NULL;     // 已经用过的地图，cells 为 NULL 表示还没读
+static unsigned char *broken = NULL;
+static const GameMap *builtin = NULL;   // 编译进程序的内置地图，不为 NULL 时不用地图包
+
+// 地图包自己的内存：所有地图的视图、损坏标记、导航距离场和视野位图都从一整块匿名映射里按顺序切出来，
+// 卸载时一次 munmap。映射按地图包里格子总数的上限预留，只有打开过的地图用到的页才真正占内存，
+// 所以打开地图包仍然不读目录，时间与地图数量无关
+static unsigned char *arena = NULL;
+static size_t arena_size = 0;
+static size_t arena_used = 0;
+
+// 每块按缓存行对齐；超出预留（目录项互相重叠时才会）返回 NULL
+static void *arena_alloc(size_t n) {
+    size_t off = (arena_used + 63) & ~(size_t)63;
+    if (off > arena_size || n > arena_size - off) return NULL;
+    arena_used = off + n;
+    return arena + off;
+}
+
+int maps_load(const char *path, const char **err) {
+    maps_unload();
+    
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        *err = "无法打开地图包";
+        return 0;
+    }
+    
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(MapPackHeader)) {
+        close(fd);
+        *err = "地图包太短";
+        return 0;
+    }
+    
+    void *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        *err = "无法映射地图包";
+        return 0;
+    }
+    
+    const MapPackHeader *h = p;
+    if (memcmp(h->magic, MAPPACK_MAGIC, 4) != 0 || h->version != MAPPACK_VERSION ||
+        h->byte_order != MAPPACK_BYTE_ORDER || h->entry_size != sizeof(MapPackEntry) ||
+        h->file_size != (uint64_t)st.st_size) {
+        munmap(p, st.st_size);
+        *err = "不是本版本的地图包";
+        return 0;
+    }
+    if (h->map_count == 0 || h->dir_offset % 8 != 0 || h->dir_offset > (uint64_t)st.st_size ||
+        h->map_count > (st.st_size - h->dir_offset) / sizeof(MapPackEntry)) {
+        munmap(p, st.st_size);
+        *err = "地图包目录损坏";
+        return 0;
+    }
+    
+    // 每张地图的格子都在文件里、互不重叠，所以格子总数不超过文件大小 / sizeof(MapCell)
+    size_t cells = st.st_size / sizeof(MapCell);
+    arena_size = (size_t)h->map_count * (sizeof(GameMap) + 1 + 2 * 64) + 64 +
+                 map_nav_bytes(1, 1) * cells + map_vis_bytes(1, 1) * cells;
+    arena = mmap(NULL, arena_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (arena == MAP_FAILED) {
+        arena = NULL;
+        munmap(p, st.st_size);
+        *err = "内存不够";
+        return 0;
+    }
+    
+    pack = p;
+    pack_size = st.st_size;
+    pack_dir = (const MapPackEntry *)(pack + h->dir_offset);
+    map_count = (int)h->map_count;
+    views = arena_alloc((size_t)map_count * sizeof(GameMap));
+    broken = arena_alloc(map_count);
+    return 1;
+}
+
+void maps_use_builtin(const GameMap *list, int n) {
+    maps_unload();
+    builtin = list;
+    map_count = n;
+}
+
+void maps_unload() {
+    if (pack) {
+        munmap((void *)pack, pack_size);
+    }
+    if (arena) {
+        munmap(arena, arena_size);
+    }
+    pack = NULL;
+    pack_size = 0;
+    pack_dir = NULL;
+    arena = NULL;
+    arena_size = 0;
+    arena_used = 0;
+    views = NULL;
+    broken = NULL;
+    builtin = NULL;
+    map_count = 0;
+}
+
+// 偏移处是不是一个以 0 结尾的字符串
+static const char *pack_string(uint32_t off) {
+    if (off >= pack_size || !memchr(pack + off, 0, pack_size - off)) return NULL;
+    return (const char *)(pack + off);
+}
+
+// 检查目录项并建立地图视图、算好导航距离场和视野，只在第一次用到这张地图时执行
+static int open_entry(int i) {
+    const MapPackEntry *e = &pack_dir[i];
+    GameMap *m = &views[i];
+    uint64_t cells_size = (uint64_t)e->width * e->height * sizeof(MapCell);
+    uint64_t doors_size = (uint64_t)e->door_count * sizeof(MapPoint);
+    
+    if (e->width == 0 || e->height == 0 || e->cells_offset % 8 != 0 || e->doors_offset % 8 != 0 ||
+        e->cells_offset + cells_size > pack_size || e->doors_offset + doors_size > pack_size) {
+        return 0;
+    }
+    
+    m->map_name = pack_string(e->name_offset);
+    m->map_id = pack_string(e->id_offset);
+    m->hint = pack_string(e->hint_offset);
+    if (!m->map_name || !m->map_id || !m->hint) return 0;
+    
+    m->type = (MapType)i;
+    m->width = e->width;
+    m->height = e->height;
+    m->hide_count = e->hide_count;
+    m->spawn_x = e->spawn_x;
+    m->spawn_y = e->spawn_y;
+    m->door_count = e->door_count;
+    m->doors = (const MapPoint *)(pack + e->doors_offset);
+    m->cells = (const MapCell *)(pack + e->cells_offset);
+    
+    // 父母只能从门进来，没有门的地图不能用
+    if (m->door_count == 0) return 0;
+    for (int d = 0; d < m->door_count; d++) {
+        if (!map_walkable(m, m->doors[d].x, m->doors[d].y)) return 0;
+    }
+    // 玩家从出生点开始，出生点在地图外会读到映射外面
+    if (!map_walkable(m, m->spawn_x, m->spawn_y)) return 0;
+    
+    m->nav = arena_alloc(map_nav_bytes(m->width, m->height));
+    m->vis = arena_alloc(map_vis_bytes(m->width, m->height));
+    if (!m->nav || !m->vis) return 0;
+    map_build_nav(m);
+    map_build_vision(m);
+    return 1;
+}
+
+const GameMap *map_get(int i) {
+    if (i < 0 || i >= map_count) return NULL;
+    if (builtin) return &builtin[i];
+    if (broken[i]) return NULL;
+    
+    if (!views[i].cells && !open_entry(i)) {
+        broken[i] = 1;
+        return NULL;
+    }
+    return &views[i];
+}
+
+static uint32_t align8(uint32_t n) {
+    return (n + 7) & ~7u;
+}
+
+// 写入 n 个 0 字节，用于对齐
+static int write_pad(FILE *f, uint32_t n) {
+    static const char zero[8];
+    return n == 0 || fwrite(zero, n, 1, f) == 1;
+}
+
+int mappack_write(const char *path, const GameMap *list, int n) {
+    MapPackHeader h;
+    MapPackEntry *dir = calloc(n, sizeof(MapPackEntry));
+    
+    // 先排好每张地图的数据位置：格子、门、三个字符串，每张地图从8字节边界开始
+    uint64_t off = sizeof(h) + (uint64_t)n * sizeof(MapPackEntry);
+    for (int i = 0; i < n; i++) {
+        const GameMap *m = &list[i];
+        MapPackEntry *e = &dir[i];
+        
+        e->cells_offset = (uint32_t)off;
+        off += (uint64_t)m->width * m->height * sizeof(MapCell);
+        e->doors_offset = (uint32_t)off;
+        off += (uint64_t)m->door_count * sizeof(MapPoint);
+        e->name_offset = (uint32_t)off;
+        off += strlen(m->map_name) + 1;
+        e->id_offset = (uint32_t)off;
+        off += strlen(m->map_id) + 1;
+        e->hint_offset = (uint32_t)off;
+        off += strlen(m->hint) + 1;
+        off = (off + 7) & ~(uint64_t)7;
+        
+        e->width = (uint16_t)m->width;
+        e->height = (uint16_t)m->height;
+        e->door_count = (uint16_t)m->door_count;
+        e->hide_count = (uint16_t)m->hide_count;
+        e->spawn_x = (int16_t)m->spawn_x;
+        e->spawn_y = (int16_t)m->spawn_y;
+    }
+    if (off > UINT32_MAX) {
+        free(dir);
+        return 0;
+    }
+    
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, MAPPACK_MAGIC, 4);
+    h.version = MAPPACK_VERSION;
+    h.entry_size = sizeof(MapPackEntry);
+    h.byte_order = MAPPACK_BYTE_ORDER;
+    h.map_count = (uint32_t)n;
+    h.dir_offset = sizeof(h);
+    h.file_size = off;
+    
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        free(dir);
+        return 0;
+    }
+    
+    int ok = fwrite(&h, sizeof(h), 1, f) == 1 && fwrite(dir, sizeof(MapPackEntry), n, f) == (size_t)n;
+    for (int i = 0; ok && i < n; i++) {
+        const GameMap *m = &list[i];
+        uint32_t len = dir[i].hint_offset + strlen(m->hint) + 1 - dir[i].cells_offset;
+        
+        ok = fwrite(m->cells, sizeof(MapCell), m->width * m->height, f) == (size_t)(m->width * m->height) &&
+             (m->door_count == 0 || fwrite(m->doors, sizeof(MapPoint), m->door_count, f) == (size_t)m->door_count) &&
+             fwrite(m->map_name, strlen(m->map_name) + 1, 1, f) == 1 &&
+             fwrite(m->map_id, strlen(m->map_id) + 1, 1, f) == 1 &&
+             fwrite(m->hint, strlen(m->hint) + 1, 1, f) == 1 &&
+             write_pad(f, align8(len) - len);
+    }
+    if (fclose(f) != 0) {
+        ok = 0;
+    }
+    free(dir);
+    return ok;
+}
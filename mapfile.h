@@ -0,0 +1,63 @@
+#ifndef MAPFILE_H
+#define MAPFILE_H
+
+#include <stdint.h>
+
+#include "game.h"
+
+// 地图包：mapc 把文本地图 (maps/*.map) 编译成的二进制文件
+// 游戏直接 mmap 整个文件使用，格子数组和名字都指向映射的内存，不解析也不逐行分配
+// 打开时只检查文件头，每张地图的目录项在第一次用到时才读（同时算导航距离场和视野），启动时间与地图数量无关
+//
+// 文件格式（小端，所有偏移从文件开头算，按8字节对齐）:
+//   文件头 32 字节 (MapPackHeader)
+//   目录   map_count 个 MapPackEntry，每个 64 字节
+//   数据   每张地图的格子数组 (MapCell，8字节)、门的坐标 (MapPoint)、名字 (UTF-8，以 0 结尾)
+
+#define MAPPACK_MAGIC "PLMP"
+#define MAPPACK_VERSION 2
+#define MAPPACK_BYTE_ORDER 0x01020304u
+
+typedef struct {
+    char magic[4];
+    uint16_t version;
+    uint16_t entry_size;    // sizeof(MapPackEntry)，兼容以后扩展目录项
+    uint32_t byte_order;    // MAPPACK_BYTE_ORDER，用来拒绝字节序不同的文件
+    uint32_t map_count;
+    uint64_t dir_offset;
+    uint64_t file_size;
+} MapPackHeader;
+
+typedef struct {
+    uint32_t name_offset;
+    uint32_t id_offset;     // ASCII 标识，批量模拟的输出用
+    uint32_t hint_offset;   // 躲藏提示，界面显示用
+    uint32_t cells_offset;
+    uint32_t doors_offset;
+    uint16_t width, height;
+    uint16_t door_count;
+    uint16_t hide_count;
+    int16_t spawn_x, spawn_y;
+    uint8_t padding[32];
+} MapPackEntry;
+
+_Static_assert(sizeof(MapPackHeader) == 32, "MapPackHeader 必须是32字节");
+_Static_assert(sizeof(MapPackEntry) == 64, "MapPackEntry 必须是64字节");
+_Static_assert(sizeof(MapCell) == 8, "MapCell 直接映射文件内容，必须是8字节");
+
+// 打开地图包，失败时返回 0 并在 err 里写原因
+int maps_load(const char *path, const char **err);
+void maps_unload();
+
+// 内置地图：mapc -c 把文本地图连同算好的导航距离场和视野生成 C 源文件 (builtin_maps.c)，
+// 全是 static const 数组，编进程序的只读数据段。用内置地图时不打开文件、不分配内存也不算导航和视野，
+// maps_use_builtin 只记下数组的位置，map_get 直接返回里面的地图
+extern const GameMap builtin_maps[];
+extern const int builtin_map_count;
+
+void maps_use_builtin(const GameMap *list, int n);
+
+// 把编译好的地图写成地图包，mapc 用
+int mappack_write(const char *path, const GameMap *list, int n);
+
+#endif
@@ -1,104 +1,275 @@
+#define _GNU_SOURCE
 #include <ncurses.h>
+#include <stdio.h>
+#include <stdarg.h>
 #include <stdlib.h>
+#include <fcntl.h>
 #include <time.h>
 #include <unistd.h>
 #include <string.h>
 #include <locale.h>
 #include <wchar.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdint.h>
+#include <sys/timerfd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/uio.h>
+#include <pthread.h>
+#include <signal.h>
+#include <errno.h>
 
-// 游戏状态枚举
-typedef enum {
-    MENU,
-    PLAYING,
-    PAUSED,
-    WIN,
-    LOST,
-    MAP_SELECTION
-} GameState;
-
-// 地图类型枚举
-typedef enum {
-    EUROPE_US,
-    VIENNA_HOTEL,
-    JAPAN
-} MapType;
-
-// 玩家状态枚举
-typedef enum {
-    PLAYING_PLANE,
-    HIDING,
-    CAUGHT
-} PlayerState;
-
-// 结构体定义
+#include "game.h"
+#include "mapfile.h"
+#include "replay.h"
+#include "trace.h"
+#include "broadcast.h"
+#include "house.h"
+#include "snapshot.h"
+#include "bot.h"
+#include "scores.h"
+
+// 全局变量
+int game_speed = 100000; // 微秒，每个模拟步的固定时长
+int render_fps = 30;      // 最高渲染帧率，与模拟步频无关
+#define MAX_CATCHUP_TICKS 5  // 卡顿后一次最多补跑的模拟步数
+
+// 录像
+int seed_fixed = 0;           // 用 --seed 指定了种子
+uint64_t seed_value = 0;
+const char *record_path = NULL;
+int replay_speed = 1;         // 重放倍速
+int autoplay = 0;             // --autoplay：每局都由自动玩家来玩
+
+// 本进程每局使用的平衡参数，--family 打开家庭聚会模式
+GameRules play_rules;
+
+// 地图，默认用编译进来的内置地图，--maps 指定地图包时才读文件
+const char *maps_path = NULL;
+#define MAPS_PER_PAGE 9
+
+// 战绩日志和排行榜 (scores.h)，--scores 修改路径；打不开时照常玩，只是不记录
+const char *scores_path = "scores.log";
+ScoreStore *scores = NULL;
+
+// 战绩写线程：分出胜负时对局线程只算名次、把记录放进队列，write + fdatasync 和更新索引都在这个线程里做，
+// 磁盘再慢也不会卡住模拟步和同一个工作线程上的其他会话
+#define RUN_QUEUE_SIZE 256
 typedef struct {
-    int x, y;
-    int score;
-    int time_played;
-    PlayerState state;
-} Player;
+    RunRecord runs[RUN_QUEUE_SIZE];
+    int head, count;
+    int stop;
+    int started;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;      // 队列里来了记录、腾出了空位或者要退出
+    pthread_t thread;
+} RunWriter;
+RunWriter run_writer = { .lock = PTHREAD_MUTEX_INITIALIZER, .cond = PTHREAD_COND_INITIALIZER };
+
+// 各颜色对的前景色，背景都是黑色；直播流按同一张表输出 ANSI 颜色
+const short pair_fg[] = {
+    [COLOR_PAIR_PLAYER] = COLOR_GREEN,
+    [COLOR_PAIR_PARENT] = COLOR_RED,
+    [COLOR_PAIR_BED] = COLOR_YELLOW,
+    [COLOR_PAIR_HIDE] = COLOR_CYAN,
+    [COLOR_PAIR_WALL] = COLOR_WHITE,
+    [COLOR_PAIR_TEXT] = COLOR_WHITE,
+    [COLOR_PAIR_WARNING] = COLOR_RED,
+    [COLOR_PAIR_MENU] = COLOR_CYAN,
+};
+#define PAIR_COUNT (int)(sizeof(pair_fg) / sizeof(pair_fg[0]))
 
+// 渲染缓冲区中的一个格子：字形 + 颜色对
+// 宽字符占两格，第二格的字形记为0（续格）
 typedef struct {
-    int x, y;
-    int active;
-    int timer;
-    int direction;  // 0:左, 1:右, 2:上, 3:下
-    char symbol;
-} Parent;
+    wchar_t ch;
+    short pair;
+} Cell;
 
+// 游戏界面的静态层：边框和视口里的地图，和 back 缓冲区一样大，地图矩形以外都是空白
+// 地图、视口位置、整栋房子的窗口或终端大小变了才重画；平常每帧只把上一帧精灵（玩家和家人）
+// 盖住的格子从这里恢复，再画这一帧的精灵，面板和提示所在的区域从这里拷回空白后重画。
+// 暂停和继续不动地图，只有提示那一行变了
 typedef struct {
-    MapType type;
-    int width, height;
-    char **layout;
-    int bed_x, bed_y;
-    int hide_x, hide_y;
-    int hide_width, hide_height;
-    char *map_name;
-} GameMap;
+    Cell *cells;
+    int valid;
+    const GameMap *map;       // 下面这些是画这一层时的参数，变了就重画
+    int cam_x, cam_y, org_cx, org_cy;
+    int w, h;                 // 地图矩形（连边框）的宽和高
+    
+    int shown;                // back 缓冲区的地图矩形里是不是这一层加上精灵
+    int partial;              // 这一帧只比较地图矩形里精灵碰过的格子（render_flush 用）
+    int *sprites;             // 这一帧画了精灵的格子（缓冲区下标），最多 MAX_NPCS + 1 个
+    int sprite_count;
+    short *span_x0, *span_x1; // 每行地图矩形里要比较的列 [x0, x1)
+} MapLayer;
 
-// 全局变量
-GameState game_state = MENU;
-MapType current_map = EUROPE_US;
-Player player;
-Parent parents[2];
-GameMap maps[3];
-int game_time = 0;
-int total_time = 0;
-int parent_check_timer = 0;
-int warning_timer = 0;
-int game_speed = 100000; // 微秒
-
-// 颜色对定义
-#define COLOR_PAIR_PLAYER 1
-#define COLOR_PAIR_PARENT 2
-#define COLOR_PAIR_BED 3
-#define COLOR_PAIR_HIDE 4
-#define COLOR_PAIR_WALL 5
-#define COLOR_PAIR_TEXT 6
-#define COLOR_PAIR_WARNING 7
-#define COLOR_PAIR_MENU 8
+// 一个终端会话：一局游戏、界面状态和渲染缓冲区
+// 本地运行时只有 console 一个会话；服务器模式下每个客户端连接一个，各有自己的 ncurses SCREEN
+typedef struct Session {
+    GameContext game;         // 当前对局，菜单状态也记录在 game.state
+    int state_dirty;          // 自上次渲染以来状态是否变化，只在变化后重绘
+    int quit;                 // 玩家选了退出
+    int show_help;            // 正在显示游戏说明，按任意键返回
+    int show_scores;          // 正在显示排行榜，N/P 换地图，其他键返回
+    int score_map;            // 排行榜显示第几张地图，map_count 是整栋房子
+    int map_page;             // 地图选择界面当前页
+    int trace_overlay;        // T 键显示各阶段耗时面板
+    House *house;             // 整栋房子模式的房子，其他地图为 NULL
+    
+    // 视口：地图比终端大时只画玩家周围的一块
+    int cam_x, cam_y;         // 视口左上角的地图坐标
+    int view_w, view_h;
+    
+    // 录像
+    Replay recording;
+    int recording_active;
+    Replay playback;
+    ReplayCursor playback_cursor;
+    int replaying;
+    
+    // 倒退和存档点：对局中每 SNAPSHOT_INTERVAL 步存一份快照，B 键退回上一份，K 键存档
+    SnapshotRing *snaps;
+    unsigned char checkpoint[SNAPSHOT_MAX_SIZE];
+    int has_checkpoint;
+    int checkpoint_time;      // 存档点的总时间（秒），显示用
+    
+    // 自动玩家 (bot.h)，第一次用到时创建
+    Bot *bot;
+    int demo;                 // 演示：1 正在玩，2 已分出胜负、等着回菜单
+    int run_logged;           // 这一局已经记进战绩
+    int run_rank;             // 上了排行榜第几名，没上榜是 0
+    
+    // 保留模式渲染器：front 是上一帧已推送到终端的内容，back 是本帧正在绘制的内容
+    Cell *front_buf;
+    Cell *back_buf;
+    cchar_t *run_buf;         // render_flush 拼接一段连续格子用
+    int buf_rows, buf_cols;
+    long bytes_last_frame;    // 上一帧写到终端的字节数，ncurses 后端数不到时为 -1
+    long cells_last_frame;    // 上一帧推送的格子数
+    int count_fd;             // 渲染基准：终端输出接到这个管道的写端，每帧从读端读空来数字节数；0 表示没有
+    MapLayer layer;
+    
+    // ANSI 后端 (--ansi)：ncurses 只管按键和终端模式，每帧变化的格子直接编码成控制序列，
+    // 放在这个跨帧复用的缓冲区里，一次 writev 写出去
+    int ansi;
+    char *ansi_buf;
+    int ansi_len, ansi_cap;
+    int ansi_y, ansi_x;       // 终端的光标位置，-1 表示不确定
+    int ansi_pair;            // 终端当前的颜色对，-1 表示不确定
+    int ansi_clear;           // 下一帧先清屏
+    
+    // 服务器模式的客户端连接，本地终端的 screen 为 NULL
+    SCREEN *screen;
+    FILE *in, *out;
+    int fd;
+    struct Session *next;     // 同一个工作线程的会话链表
+} Session;
+
+Session console = { .state_dirty = 1, .fd = -1 };
+Session *ses = &console;      // 正在处理的会话，绘制和处理按键的函数都通过它访问
+
+// 事件循环统计：每秒被唤醒的次数
+long wakeups = 0;
+long long wakeup_window_start = 0;
+int wakeups_per_sec = 0;
+
+// 终端输出用 ANSI 后端而不是 ncurses 的 refresh，--ansi 打开
+int ansi_backend = 0;
+
+// 整栋房子模式的房子大小（格），--house-size 修改
+int house_w = 4096, house_h = 4096;
+
+// 演示 (attract mode)：菜单上 attract_us 没有按键，就让自动玩家随机挑一张地图玩一局，
+// 分出胜负后停 ATTRACT_END_US 回到菜单；演示时按任意键回到菜单。--attract 0 关掉
+long long attract_us = 20000000;
+#define ATTRACT_END_US 3000000LL
+long long idle_since = 0;     // 上次按键或演示结束的时间
+
+// 每隔多少步存一份快照（1秒），快照环能存下最近几分钟
+#define SNAPSHOT_INTERVAL 10
+
+// 地图右侧信息面板的宽度，视口最多占到终端宽度减去它
+#define PANEL_WIDTH 34
+
+// 热路径计时：--trace 在退出时导出跟踪文件
+const char *trace_path = NULL;
 
 // 函数声明
 void init_ncurses();
-void init_maps();
-void init_game();
+void setup_screen();
+void update_camera();
+void draw_border();
 void draw_map();
+void compose_map();
+int to_screen(int x, int y, int *sy, int *sx);
 void draw_player();
-void draw_parents();
+void draw_npcs();
 void draw_ui();
-void update_game();
 void handle_input(int ch);
-void spawn_parent();
-void move_parents();
-void check_collisions();
 void draw_menu();
 void draw_map_selection();
+void draw_help();
+void draw_scores();
 void cleanup();
+void session_close();
+void render_resize();
+void render_begin();
+void put_cell(int y, int x, wchar_t ch, int pair);
+void put_str(int y, int x, int pair, const char *fmt, ...);
+void put_cells(int y, int x, const MapCell *cells, int n);
+void render_flush();
+void render_frame();
+void draw_stats();
+void draw_trace();
+void set_tick_timer(int fd, int step_us);
+void session_read_keys();
+int run_server(const char *path);
+long drain_count_pipe();
+long long now_us();
+uint64_t new_seed();
+void start_game(MapType map);
+void stop_recording();
+void reset_snapshots();
+void session_snapshot(Session *s);
+void session_log_run(Session *s);
+void run_writer_start();
+void run_writer_stop();
+void rewind_game();
+void save_checkpoint();
+void load_checkpoint();
+void start_demo();
+long long attract_deadline();
+void attract_update(long long now);
+void bot_play();
+void player_move(GameInput in);
+int run_render_bench(int json);
+
+// 渲染基准用：读空输出管道，返回读到的字节数
+// ncurses 绕过 FILE 直接往文件描述符写，包装 FILE 数不到，只能在管道另一头数
+long drain_count_pipe() {
+    char buf[65536];
+    long total = 0;
+    ssize_t n;
+    while ((n = read(ses->count_fd, buf, sizeof(buf))) > 0) {
+        total += n;
+    }
+    return total;
+}
 
 // 初始化ncurses
 void init_ncurses() {
-    setlocale(LC_ALL, "zh_CN.UTF-8");
+    if (!setlocale(LC_ALL, "zh_CN.UTF-8")) {
+        setlocale(LC_ALL, "");
+    }
     initscr();
+    setup_screen();
+}
+
+// 终端模式、颜色和渲染缓冲区，initscr 或 newterm 之后调用
+void setup_screen() {
     cbreak();
     noecho();
     keypad(stdscr, TRUE);
@@ -108,495 +279,777 @@ void init_ncurses() {
     // 初始化颜色
     if (has_colors()) {
         start_color();
-        init_pair(COLOR_PAIR_PLAYER, COLOR_GREEN, COLOR_BLACK);
-        init_pair(COLOR_PAIR_PARENT, COLOR_RED, COLOR_BLACK);
-        init_pair(COLOR_PAIR_BED, COLOR_YELLOW, COLOR_BLACK);
-        init_pair(COLOR_PAIR_HIDE, COLOR_CYAN, COLOR_BLACK);
-        init_pair(COLOR_PAIR_WALL, COLOR_WHITE, COLOR_BLACK);
-        init_pair(COLOR_PAIR_TEXT, COLOR_WHITE, COLOR_BLACK);
-        init_pair(COLOR_PAIR_WARNING, COLOR_RED, COLOR_BLACK);
-        init_pair(COLOR_PAIR_MENU, COLOR_CYAN, COLOR_BLACK);
-    }
-}
-
-// 初始化地图
-void init_maps() {
-    // 欧美地图
-    maps[EUROPE_US].type = EUROPE_US;
-    maps[EUROPE_US].width = 40;
-    maps[EUROPE_US].height = 20;
-    maps[EUROPE_US].map_name = "欧美卧室";
-    maps[EUROPE_US].bed_x = 5;
-    maps[EUROPE_US].bed_y = 5;
-    maps[EUROPE_US].hide_x = 25;
-    maps[EUROPE_US].hide_y = 8;
-    maps[EUROPE_US].hide_width = 8;
-    maps[EUROPE_US].hide_height = 4;
-    
-    // 分配内存并创建布局
-    maps[EUROPE_US].layout = malloc(maps[EUROPE_US].height * sizeof(char*));
-    for (int i = 0; i < maps[EUROPE_US].height; i++) {
-        maps[EUROPE_US].layout[i] = malloc((maps[EUROPE_US].width + 1) * sizeof(char));
-    }
-    
-    // 创建欧美地图布局
-    strcpy(maps[EUROPE_US].layout[0],  "########################################");
-    strcpy(maps[EUROPE_US].layout[1],  "#      门                    窗       #");
-    strcpy(maps[EUROPE_US].layout[2],  "#                                    #");
-    strcpy(maps[EUROPE_US].layout[3],  "#  #############      #############  #");
-    strcpy(maps[EUROPE_US].layout[4],  "#  #    床     #      #  学习区    #  #");
-    strcpy(maps[EUROPE_US].layout[5],  "#  #  ([ ])   #      #   [书桌]   #  #");
-    strcpy(maps[EUROPE_US].layout[6],  "#  #   / \\    #      #   椅子     #  #");
-    strcpy(maps[EUROPE_US].layout[7],  "#  #############      #############  #");
-    strcpy(maps[EUROPE_US].layout[8],  "#                                    #");
-    strcpy(maps[EUROPE_US].layout[9],  "#              衣柜                   #");
-    strcpy(maps[EUROPE_US].layout[10], "#                                    #");
-    strcpy(maps[EUROPE_US].layout[11], "########################################");
-
-    // 维也纳艺术酒店地图
-    maps[VIENNA_HOTEL].type = VIENNA_HOTEL;
-    maps[VIENNA_HOTEL].width = 40;
-    maps[VIENNA_HOTEL].height = 20;
-    maps[VIENNA_HOTEL].map_name = "维也纳艺术酒店";
-    maps[VIENNA_HOTEL].bed_x = 8;
-    maps[VIENNA_HOTEL].bed_y = 6;
-    maps[VIENNA_HOTEL].hide_x = 20;
-    maps[VIENNA_HOTEL].hide_y = 10;
-    maps[VIENNA_HOTEL].hide_width = 6;
-    maps[VIENNA_HOTEL].hide_height = 3;
-    
-    maps[VIENNA_HOTEL].layout = malloc(maps[VIENNA_HOTEL].height * sizeof(char*));
-    for (int i = 0; i < maps[VIENNA_HOTEL].height; i++) {
-        maps[VIENNA_HOTEL].layout[i] = malloc((maps[VIENNA_HOTEL].width + 1) * sizeof(char));
-    }
-    
-    // 创建维也纳酒店布局
-    strcpy(maps[VIENNA_HOTEL].layout[0],  "########################################");
-    strcpy(maps[VIENNA_HOTEL].layout[1],  "#   豪华套房 - 维也纳艺术酒店        #");
-    strcpy(maps[VIENNA_HOTEL].layout[2],  "#                                    #");
-    strcpy(maps[VIENNA_HOTEL].layout[3],  "#  #####        #####        #####  #");
-    strcpy(maps[VIENNA_HOTEL].layout[4],  "#  #床#        #艺术#        #电视#  #");
-    strcpy(maps[VIENNA_HOTEL].layout[5],  "#  #([ ])      #画 #        #椅子#  #");
-    strcpy(maps[VIENNA_HOTEL].layout[6],  "#  # / \\       #####         ###  #");
-    strcpy(maps[VIENNA_HOTEL].layout[7],  "#                                    #");
-    strcpy(maps[VIENNA_HOTEL].layout[8],  "#      浴室              阳台        #");
-    strcpy(maps[VIENNA_HOTEL].layout[9],  "#                                    #");
-    strcpy(maps[VIENNA_HOTEL].layout[10], "########################################");
-
-    // 日本地图
-    maps[JAPAN].type = JAPAN;
-    maps[JAPAN].width = 40;
-    maps[JAPAN].height = 20;
-    maps[JAPAN].map_name = "日本和室";
-    maps[JAPAN].bed_x = 6;
-    maps[JAPAN].bed_y = 8;
-    maps[JAPAN].hide_x = 26;
-    maps[JAPAN].hide_y = 7;
-    maps[JAPAN].hide_width = 8;
-    maps[JAPAN].hide_height = 4;
-    
-    maps[JAPAN].layout = malloc(maps[JAPAN].height * sizeof(char*));
-    for (int i = 0; i < maps[JAPAN].height; i++) {
-        maps[JAPAN].layout[i] = malloc((maps[JAPAN].width + 1) * sizeof(char));
-    }
-    
-    // 创建日本地图布局
-    strcpy(maps[JAPAN].layout[0],  "########################################");
-    strcpy(maps[JAPAN].layout[1],  "#    日本和室 - 障子と畳             #");
-    strcpy(maps[JAPAN].layout[2],  "#                                    #");
-    strcpy(maps[JAPAN].layout[3],  "#   #####            #####          #");
-    strcpy(maps[JAPAN].layout[4],  "#   #布団#           #学习#         #");
-    strcpy(maps[JAPAN].layout[5],  "#   #([ ])           #区域#         #");
-    strcpy(maps[JAPAN].layout[6],  "#   #####            机と椅子       #");
-    strcpy(maps[JAPAN].layout[7],  "#                                    #");
-    strcpy(maps[JAPAN].layout[8],  "#    押入れ              床の間       #");
-    strcpy(maps[JAPAN].layout[9],  "#                                    #");
-    strcpy(maps[JAPAN].layout[10], "########################################");
-}
-
-// 初始化游戏
-void init_game() {
-    player.x = maps[current_map].bed_x;
-    player.y = maps[current_map].bed_y;
-    player.score = 0;
-    player.time_played = 0;
-    player.state = PLAYING_PLANE;
-    
-    // 初始化父母
-    for (int i = 0; i < 2; i++) {
-        parents[i].active = 0;
-        parents[i].symbol = 'P';
-    }
-    
-    game_time = 0;
-    total_time = 0;
-    parent_check_timer = 0;
-    warning_timer = 0;
-    game_state = PLAYING;
-}
-
-// 绘制地图
-void draw_map() {
-    GameMap *map = &maps[current_map];
-    
-    for (int y = 0; y < map->height; y++) {
-        for (int x = 0; x < map->width; x++) {
-            char ch = map->layout[y][x];
-            
-            // 检查是否在隐藏区域
-            int in_hide_area = (x >= map->hide_x && x < map->hide_x + map->hide_width &&
-                               y >= map->hide_y && y < map->hide_y + map->hide_height);
-            
-            // 检查是否在床上区域
-            int in_bed_area = (x >= map->bed_x - 1 && x <= map->bed_x + 1 &&
-                              y >= map->bed_y - 1 && y <= map->bed_y + 1);
-            
-            // 设置颜色
-            if (in_bed_area && ch != '#') {
-                attron(COLOR_PAIR(COLOR_PAIR_BED));
-            } else if (in_hide_area && ch != '#') {
-                attron(COLOR_PAIR(COLOR_PAIR_HIDE));
-            } else if (ch == '#') {
-                attron(COLOR_PAIR(COLOR_PAIR_WALL));
-            } else {
-                attron(COLOR_PAIR(COLOR_PAIR_TEXT));
-            }
-            
-            mvaddch(y + 2, x + 2, ch);
-            attroff(COLOR_PAIR(COLOR_PAIR_TEXT));
+        for (int p = 1; p < PAIR_COUNT; p++) {
+            init_pair(p, pair_fg[p], COLOR_BLACK);
         }
     }
-}
-
-// 绘制玩家
-void draw_player() {
-    attron(COLOR_PAIR(COLOR_PAIR_PLAYER));
     
-    // 根据状态选择符号
-    char symbol;
-    switch (player.state) {
-        case PLAYING_PLANE:
-            symbol = 'A';  // 飞机
-            break;
-        case HIDING:
-            symbol = 'S';  // 学习/看电视
-            break;
-        case CAUGHT:
-            symbol = 'X';  // 被抓
-            break;
+    // 先让 ncurses 把初始化和清屏输出完，之后它不再往终端写东西
+    ses->ansi = ansi_backend;
+    if (ses->ansi) {
+        refresh();
     }
-    
-    mvaddch(player.y + 2, player.x + 2, symbol);
-    attroff(COLOR_PAIR(COLOR_PAIR_PLAYER));
+    render_resize();
 }
 
-// 绘制父母
-void draw_parents() {
-    for (int i = 0; i < 2; i++) {
-        if (parents[i].active) {
-            attron(COLOR_PAIR(COLOR_PAIR_PARENT));
-            mvaddch(parents[i].y + 2, parents[i].x + 2, parents[i].symbol);
-            attroff(COLOR_PAIR(COLOR_PAIR_PARENT));
+// 按当前终端大小重新分配缓冲区，并强制下一帧全部重绘
+void render_resize() {
+    MapLayer *l = &ses->layer;
+    free(ses->front_buf);
+    free(ses->back_buf);
+    free(ses->run_buf);
+    free(l->cells);
+    free(l->sprites);
+    free(l->span_x0);
+    free(l->span_x1);
+    ses->buf_rows = LINES;
+    ses->buf_cols = COLS;
+    ses->front_buf = malloc(ses->buf_rows * ses->buf_cols * sizeof(Cell));
+    ses->back_buf = malloc(ses->buf_rows * ses->buf_cols * sizeof(Cell));
+    ses->run_buf = malloc(ses->buf_cols * sizeof(cchar_t));
+    l->cells = malloc(ses->buf_rows * ses->buf_cols * sizeof(Cell));
+    l->sprites = malloc((MAX_NPCS + 1) * sizeof(int));
+    l->span_x0 = malloc(ses->buf_rows * sizeof(short));
+    l->span_x1 = malloc(ses->buf_rows * sizeof(short));
+    l->valid = 0;
+    l->shown = 0;
+    l->partial = 0;
+    l->sprite_count = 0;
+    for (int i = 0; i < ses->buf_rows * ses->buf_cols; i++) {
+        ses->front_buf[i].ch = L' ';
+        ses->front_buf[i].pair = -1;  // 不可能的颜色对，保证第一帧全部推送
+    }
+    if (ses->ansi) {
+        // 自己清屏，终端上就是一屏空格，只需要输出不是空白的格子
+        for (int i = 0; i < ses->buf_rows * ses->buf_cols; i++) {
+            ses->front_buf[i].pair = 0;
         }
+        ses->ansi_clear = 1;
+    } else {
+        clear();
     }
+    bcast_force_keyframe();  // 观众那边也整屏重画
 }
 
-// 绘制UI
-void draw_ui() {
-    // 绘制边框
-    attron(COLOR_PAIR(COLOR_PAIR_WALL));
-    for (int i = 0; i < maps[current_map].width + 4; i++) {
-        mvaddch(0, i, '#');
-        mvaddch(maps[current_map].height + 3, i, '#');
+// 开始新的一帧：back 缓冲区清空为空格
+void render_begin() {
+    ses->layer.shown = 0;
+    ses->layer.partial = 0;
+    for (int i = 0; i < ses->buf_rows * ses->buf_cols; i++) {
+        ses->back_buf[i].ch = L' ';
+        ses->back_buf[i].pair = 0;
     }
-    for (int i = 0; i < maps[current_map].height + 4; i++) {
-        mvaddch(i, 0, '#');
-        mvaddch(i, maps[current_map].width + 3, '#');
+}
+
+// 向 back 缓冲区写一个字形，处理宽字符与续格的相互覆盖
+void put_cell(int y, int x, wchar_t ch, int pair) {
+    if (y < 0 || y >= ses->buf_rows || x < 0 || x >= ses->buf_cols) return;
+    if (ch == 0) {
+        ch = L' ';  // 0 留给续格使用
     }
-    attroff(COLOR_PAIR(COLOR_PAIR_WALL));
     
-    // 绘制游戏信息
-    attron(COLOR_PAIR(COLOR_PAIR_TEXT));
-    mvprintw(1, maps[current_map].width + 6, "游戏: 不要让你的父母发现你在起飞");
-    mvprintw(3, maps[current_map].width + 6, "地图: %s", maps[current_map].map_name);
-    mvprintw(5, maps[current_map].width + 6, "状态: %s", 
-             player.state == PLAYING_PLANE ? "玩飞机游戏中" :
-             player.state == HIDING ? "躲避中" : "被抓了!");
-    mvprintw(7, maps[current_map].width + 6, "游戏时间: %d秒", game_time);
-    mvprintw(9, maps[current_map].width + 6, "总时间: %d/100秒", total_time);
-    mvprintw(11, maps[current_map].width + 6, "剩余父母检查: %d", 
-             15 - parent_check_timer);
-    mvprintw(13, maps[current_map].width + 6, "得分: %d", player.score);
+    int w = wcwidth(ch);
+    if (w < 1) {
+        w = 1;
+    }
+    if (x + w > ses->buf_cols) return;
     
-    // 绘制控制说明
-    mvprintw(15, maps[current_map].width + 6, "控制:");
-    mvprintw(16, maps[current_map].width + 6, "WASD/方向键 - 移动");
-    mvprintw(17, maps[current_map].width + 6, "空格 - 开始/暂停");
-    mvprintw(18, maps[current_map].width + 6, "M - 返回菜单");
-    mvprintw(19, maps[current_map].width + 6, "Q - 退出游戏");
+    Cell *row = &ses->back_buf[y * ses->buf_cols];
     
-    // 绘制提示
-    mvprintw(21, maps[current_map].width + 6, "提示:");
-    mvprintw(22, maps[current_map].width + 6, "- 父母来时躲到%s区域",
-             current_map == VIENNA_HOTEL ? "椅子看电视" : "学习区");
-    mvprintw(23, maps[current_map].width + 6, "- 坚持100秒即可胜利!");
+    // 覆盖宽字符的后半格时，把前半格清掉
+    if (row[x].ch == 0 && x > 0) {
+        row[x - 1].ch = L' ';
+    }
+    // 覆盖宽字符的前半格时，把它的续格清掉
+    int end = x + w;
+    if (end < ses->buf_cols && row[end].ch == 0) {
+        row[end].ch = L' ';
+    }
     
-    // 警告信息
-    if (warning_timer > 0) {
-        attron(COLOR_PAIR(COLOR_PAIR_WARNING));
-        mvprintw(25, maps[current_map].width + 6, "警告: 父母来了! 快躲起来!");
-        warning_timer--;
-        attroff(COLOR_PAIR(COLOR_PAIR_WARNING));
+    row[x].ch = ch;
+    row[x].pair = pair;
+    if (w == 2) {
+        row[x + 1].ch = 0;
+        row[x + 1].pair = pair;
     }
+}
+
+// 向 back 缓冲区写一行格式化文本（UTF-8）
+void put_str(int y, int x, int pair, const char *fmt, ...) {
+    char text[256];
+    wchar_t wtext[256];
+    va_list ap;
     
-    attroff(COLOR_PAIR(COLOR_PAIR_TEXT));
+    va_start(ap, fmt);
+    vsnprintf(text, sizeof(text), fmt, ap);
+    va_end(ap);
+    
+    size_t n = mbstowcs(wtext, text, 256);
+    if (n == (size_t)-1) return;
+    
+    for (size_t i = 0; i < n; i++) {
+        put_cell(y, x, wtext[i], pair);
+        int w = wcwidth(wtext[i]);
+        x += w < 1 ? 1 : w;
+    }
 }
 
-// 更新游戏逻辑
-void update_game() {
-    if (game_state != PLAYING) return;
+// 把一整段地图格子拷进 back 缓冲区（续格约定相同，可以直接拷）
+void put_cells(int y, int x, const MapCell *cells, int n) {
+    if (y < 0 || y >= ses->buf_rows || x < 0) return;
+    if (x + n > ses->buf_cols) {
+        n = ses->buf_cols - x;
+    }
+    if (n <= 0) return;
     
-    game_time++;
+    Cell *row = &ses->back_buf[y * ses->buf_cols];
     
-    // 每10秒增加游戏时间
-    if (game_time % 10 == 0) {
-        total_time++;
-        player.score += 10;
+    // 两端和已有宽字符重叠时先清掉
+    if (row[x].ch == 0 && x > 0) {
+        row[x - 1].ch = L' ';
+    }
+    if (x + n < ses->buf_cols && row[x + n].ch == 0) {
+        row[x + n].ch = L' ';
+    }
+    
+    for (int i = 0; i < n; i++) {
+        row[x + i].ch = (wchar_t)cells[i].glyph;
+        row[x + i].pair = cells[i].pair;
+    }
+    
+    // 行尾被截断的宽字符改成空格
+    if (cells[n - 1].width == 2) {
+        row[x + n - 1].ch = L' ';
+    }
+}
+
+// 直播流的编码缓冲区，快满时先追加进环形缓冲区
+char bc_buf[8192];
+int bc_len = 0;
+int bc_pair = -1;  // 观众终端当前的颜色对，-1 表示未知
+
+void bc_flush() {
+    bcast_write(bc_buf, bc_len);
+    bc_len = 0;
+}
+
+// 把一段格子编码成 ANSI：光标定位，颜色变了才输出 SGR，字形按 UTF-8 输出，续格跳过
+void broadcast_cells(int y, int x, const Cell *cells, int n) {
+    if (bc_len > (int)sizeof(bc_buf) - 32) {
+        bc_flush();
+    }
+    bc_len += sprintf(bc_buf + bc_len, "\x1b[%d;%dH", y + 1, x + 1);
+    
+    for (int i = 0; i < n; i++) {
+        if (cells[i].ch == 0) continue;
+        if (bc_len > (int)sizeof(bc_buf) - 32) {
+            bc_flush();
+        }
         
-        // 检查胜利条件
-        if (total_time >= 100) {
-            game_state = WIN;
-            return;
+        int pair = cells[i].pair;
+        if (pair != bc_pair) {
+            if (pair > 0 && pair < PAIR_COUNT) {
+                bc_len += sprintf(bc_buf + bc_len, "\x1b[0;%d;40m", 30 + pair_fg[pair]);
+            } else {
+                bc_len += sprintf(bc_buf + bc_len, "\x1b[0m");
+            }
+            bc_pair = pair;
+        }
+        
+        mbstate_t st = { 0 };
+        size_t k = wcrtomb(bc_buf + bc_len, cells[i].ch, &st);
+        if (k == (size_t)-1) {
+            bc_buf[bc_len] = '?';
+            k = 1;
         }
+        bc_len += k;
     }
+}
+
+// 关键帧：清屏后只输出非空白的格子
+void broadcast_keyframe() {
+    bc_len += sprintf(bc_buf + bc_len, "\x1b[?25l\x1b[0m\x1b[H\x1b[2J");
+    bc_pair = 0;
     
-    // 更新父母检查计时器
-    parent_check_timer++;
-    if (parent_check_timer >= 15) {  // 每15秒父母可能来检查
-        if (rand() % 100 < 30) {  // 30%概率触发检查
-            spawn_parent();
-            warning_timer = 20;  // 显示警告2秒
+    for (int y = 0; y < ses->buf_rows; y++) {
+        Cell *f = &ses->front_buf[y * ses->buf_cols];
+        int x = 0;
+        while (x < ses->buf_cols) {
+            if (f[x].ch == L' ' && f[x].pair <= 0) {
+                x++;
+                continue;
+            }
+            int start = x;
+            while (x < ses->buf_cols && (f[x].ch != L' ' || f[x].pair > 0)) {
+                x++;
+            }
+            broadcast_cells(y, start, f + start, x - start);
         }
-        parent_check_timer = 0;
     }
+}
+
+// ANSI 后端的缓冲区留出 n 字节的空间
+void ansi_reserve(int n) {
+    if (ses->ansi_len + n <= ses->ansi_cap) return;
+    ses->ansi_cap = ses->ansi_cap ? ses->ansi_cap * 2 : 16384;
+    if (ses->ansi_cap < ses->ansi_len + n) {
+        ses->ansi_cap = ses->ansi_len + n;
+    }
+    ses->ansi_buf = realloc(ses->ansi_buf, ses->ansi_cap);
+}
+
+// 光标移到 (y, x)：同一行上用相对移动或者把中间没变的几个字符重写一遍，
+// 下一行行首用 \r\n，其余用绝对定位，挑最短的那个
+void ansi_move(int y, int x) {
+    char best[32], alt[32];
+    int n, k;
     
-    // 移动父母
-    move_parents();
+    if (y == ses->ansi_y && x == ses->ansi_x) return;
+    ansi_reserve(32);
     
-    // 检查碰撞
-    check_collisions();
+    if (x == 0) {
+        n = sprintf(best, "\x1b[%dH", y + 1);
+    } else {
+        n = sprintf(best, "\x1b[%d;%dH", y + 1, x + 1);
+    }
+    if (y == ses->ansi_y && ses->ansi_x >= 0) {
+        int d = x - ses->ansi_x;
+        if (d > 0) {
+            // 中间是同一颜色的 ASCII 字符时，重写它们比移动光标还短
+            const Cell *f = &ses->front_buf[y * ses->buf_cols + ses->ansi_x];
+            int plain = d < 4;
+            for (int i = 0; i < d && plain; i++) {
+                plain = f[i].ch > 0 && f[i].ch < 0x80 && f[i].pair == ses->ansi_pair;
+            }
+            if (plain && d < n) {
+                for (int i = 0; i < d; i++) {
+                    ses->ansi_buf[ses->ansi_len++] = (char)f[i].ch;
+                }
+                ses->ansi_x = x;
+                return;
+            }
+            k = d == 1 ? sprintf(alt, "\x1b[C") : sprintf(alt, "\x1b[%dC", d);
+        } else {
+            k = d == -1 ? sprintf(alt, "\b") : sprintf(alt, "\x1b[%dD", -d);
+        }
+        if (k < n) {
+            memcpy(best, alt, k);
+            n = k;
+        }
+    } else if (y == ses->ansi_y + 1 && ses->ansi_y >= 0) {
+        k = x == 0 ? sprintf(alt, "\r\n") : x == 1 ? sprintf(alt, "\r\n\x1b[C") : sprintf(alt, "\r\n\x1b[%dC", x);
+        if (k < n) {
+            memcpy(best, alt, k);
+            n = k;
+        }
+    }
+    
+    memcpy(ses->ansi_buf + ses->ansi_len, best, n);
+    ses->ansi_len += n;
+    ses->ansi_y = y;
+    ses->ansi_x = x;
+}
+
+// 切换颜色对：背景一直是黑色，两个颜色对之间只需要换前景色
+void ansi_color(int pair) {
+    if (pair == ses->ansi_pair) return;
+    ansi_reserve(16);
+    if (pair <= 0 || pair >= PAIR_COUNT) {
+        ses->ansi_len += sprintf(ses->ansi_buf + ses->ansi_len, "\x1b[m");
+        pair = 0;
+    } else if (ses->ansi_pair > 0) {
+        ses->ansi_len += sprintf(ses->ansi_buf + ses->ansi_len, "\x1b[%dm", 30 + pair_fg[pair]);
+    } else {
+        ses->ansi_len += sprintf(ses->ansi_buf + ses->ansi_len, "\x1b[0;%d;40m", 30 + pair_fg[pair]);
+    }
+    ses->ansi_pair = pair;
+}
+
+// 把一段格子编码进 ANSI 缓冲区，续格跳过
+void ansi_cells(int y, int x, const Cell *cells, int n) {
+    ansi_move(y, x);
+    for (int i = 0; i < n; i++) {
+        if (cells[i].ch == 0) continue;
+        ansi_color(cells[i].pair);
+        ansi_reserve(MB_LEN_MAX);
+        
+        mbstate_t st = { 0 };
+        size_t k = wcrtomb(ses->ansi_buf + ses->ansi_len, cells[i].ch, &st);
+        if (k == (size_t)-1) {
+            ses->ansi_buf[ses->ansi_len] = '?';
+            k = 1;
+        }
+        ses->ansi_len += k;
+        int w = wcwidth(cells[i].ch);
+        ses->ansi_x += w == 2 ? 2 : 1;
+    }
+    // 写到最后一列以后光标停在哪里各个终端不一样
+    if (ses->ansi_x >= ses->buf_cols) {
+        ses->ansi_y = ses->ansi_x = -1;
+    }
+}
+
+// 把一帧写到终端：前后加上同步输出标记 (DEC 2026)，终端收齐整帧才显示，一次 writev
+// 返回写出的字节数
+long ansi_write_frame() {
+    static char begin[] = "\x1b[?2026h", end[] = "\x1b[?2026l";
+    if (ses->ansi_len == 0) return 0;
     
-    // 检查玩家是否在正确位置
-    GameMap *map = &maps[current_map];
-    int in_hide_area = (player.x >= map->hide_x && player.x < map->hide_x + map->hide_width &&
-                       player.y >= map->hide_y && player.y < map->hide_y + map->hide_height);
+    struct iovec iov[3] = {
+        { begin, sizeof(begin) - 1 },
+        { ses->ansi_buf, ses->ansi_len },
+        { end, sizeof(end) - 1 },
+    };
+    int fd = ses->out ? fileno(ses->out) : STDOUT_FILENO;
+    long total = 0;
+    struct iovec *v = iov;
+    int cnt = 3;
     
-    // 如果有活跃的父母，玩家应该在隐藏区域
-    int active_parent = 0;
-    for (int i = 0; i < 2; i++) {
-        if (parents[i].active) {
-            active_parent = 1;
+    // 终端或套接字一次收不下时接着写剩下的
+    while (cnt > 0) {
+        ssize_t k = writev(fd, v, cnt);
+        if (k < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN) {
+                struct pollfd p = { .fd = fd, .events = POLLOUT };
+                poll(&p, 1, 100);
+                continue;
+            }
             break;
         }
+        total += k;
+        while (cnt > 0 && (size_t)k >= v->iov_len) {
+            k -= v->iov_len;
+            v++;
+            cnt--;
+        }
+        if (cnt > 0) {
+            v->iov_base = (char *)v->iov_base + k;
+            v->iov_len -= k;
+        }
     }
+    ses->ansi_len = 0;
+    return total;
+}
+
+// 把一行里 [x, end) 中和上一帧不同的格子推送给 ncurses，连续变化的一段用一次 mvadd_wchnstr 输出
+// 直播时同一段也编码进直播流
+void flush_row(int y, int x, int end, int bc_key) {
+    Cell *b = &ses->back_buf[y * ses->buf_cols];
+    Cell *f = &ses->front_buf[y * ses->buf_cols];
     
-    if (active_parent) {
-        if (in_hide_area) {
-            player.state = HIDING;
-            player.score += 5;  // 成功躲避加分
+    while (x < end) {
+        if (b[x].ch == f[x].ch && b[x].pair == f[x].pair) {
+            x++;
+            continue;
+        }
+        
+        // 宽字符的续格变了，从它的前半格开始输出
+        int start = (b[x].ch == 0 && x > 0) ? x - 1 : x;
+        int n = 0;
+        x = start;
+        do {
+            f[x] = b[x];
+            if (b[x].ch != 0) {
+                wchar_t wstr[2] = { b[x].ch, 0 };
+                setcchar(&ses->run_buf[n++], wstr, A_NORMAL, b[x].pair, NULL);
+            }
+            x++;
+        } while (x < ses->buf_cols && (b[x].ch != f[x].ch || b[x].pair != f[x].pair || b[x].ch == 0));
+        if (ses->ansi) {
+            ansi_cells(y, start, b + start, x - start);
         } else {
-            player.state = PLAYING_PLANE;
+            mvadd_wchnstr(y, start, ses->run_buf, n);
         }
-    } else {
-        // 检查是否在床上玩飞机
-        int in_bed_area = (player.x >= map->bed_x - 1 && player.x <= map->bed_x + 1 &&
-                          player.y >= map->bed_y - 1 && player.y <= map->bed_y + 1);
-        if (in_bed_area) {
-            player.state = PLAYING_PLANE;
-            player.score += 2;  // 在床上玩飞机加分
+        if (bc_key == 0) {
+            broadcast_cells(y, start, b + start, x - start);
+        }
+        ses->cells_last_frame += x - start;
+    }
+}
+
+// 只把和上一帧不同的格子推送给 ncurses，然后刷新
+// 静态层没重画时，地图矩形里只有精灵碰过的格子可能变了，其余部分不用逐格比较
+void render_flush() {
+    uint64_t t0 = trace_now();
+    int bc_key = bcast_active() ? bcast_begin_frame() : -1;
+    MapLayer *l = &ses->layer;
+    ses->cells_last_frame = 0;
+    if (ses->ansi_clear) {
+        ansi_reserve(16);
+        ses->ansi_len += sprintf(ses->ansi_buf + ses->ansi_len, "\x1b[m\x1b[H\x1b[2J");
+        ses->ansi_y = ses->ansi_x = 0;
+        ses->ansi_pair = 0;
+        ses->ansi_clear = 0;
+    }
+    for (int y = 0; y < ses->buf_rows; y++) {
+        if (l->partial && y < l->h) {
+            flush_row(y, l->span_x0[y], l->span_x1[y], bc_key);
+            flush_row(y, l->w, ses->buf_cols, bc_key);
         } else {
-            player.state = HIDING;
+            flush_row(y, 0, ses->buf_cols, bc_key);
+        }
+    }
+    
+    if (bc_key >= 0) {
+        if (bc_key) {
+            broadcast_keyframe();
+        }
+        bc_flush();
+        bcast_end_frame();
+    }
+    
+    trace_record(PHASE_FLUSH, t0, trace_now());
+    
+    if (ses->ansi) {
+        uint64_t t1 = trace_now();
+        ses->bytes_last_frame = ansi_write_frame();
+        trace_record(PHASE_REFRESH, t1, trace_now());
+        if (ses->count_fd > 0) {
+            drain_count_pipe();
         }
+        return;
     }
+    TRACE_TIMED(PHASE_REFRESH, refresh());
+    ses->bytes_last_frame = ses->count_fd > 0 ? drain_count_pipe() : -1;
 }
 
-// 生成父母
-void spawn_parent() {
-    for (int i = 0; i < 2; i++) {
-        if (!parents[i].active) {
-            parents[i].active = 1;
-            parents[i].x = rand() % maps[current_map].width;
-            parents[i].y = rand() % maps[current_map].height;
-            parents[i].timer = 50;  // 父母存在时间
-            parents[i].direction = rand() % 4;
-            break;
+// 视口跟着玩家走，到了地图边上就停住；地图放得下时视口就是整张地图
+void update_camera() {
+    const GameMap *map = ses->game.map;
+    int w = ses->buf_cols - PANEL_WIDTH - 6;
+    int h = ses->buf_rows - 7;
+    
+    ses->view_w = map->width < w ? map->width : w > 1 ? w : 1;
+    ses->view_h = map->height < h ? map->height : h > 1 ? h : 1;
+    
+    int x = ses->game.player.x - ses->view_w / 2;
+    int y = ses->game.player.y - ses->view_h / 2;
+    ses->cam_x = x < 0 ? 0 : x > map->width - ses->view_w ? map->width - ses->view_w : x;
+    ses->cam_y = y < 0 ? 0 : y > map->height - ses->view_h ? map->height - ses->view_h : y;
+}
+
+// 绘制地图：格子在加载时已经编译好，视口里的每一行整段拷进缓冲区
+void draw_map() {
+    const GameMap *map = ses->game.map;
+    
+    for (int y = 0; y < ses->view_h; y++) {
+        const MapCell *row = map_cell(map, ses->cam_x, ses->cam_y + y);
+        put_cells(y + 2, 2, row, ses->view_w);
+        if (row->glyph == 0) {
+            put_cell(y + 2, 2, ' ', COLOR_PAIR_TEXT);  // 视口左边切开了一个宽字符
         }
     }
 }
 
-// 移动父母
-void move_parents() {
-    for (int i = 0; i < 2; i++) {
-        if (parents[i].active) {
-            parents[i].timer--;
-            if (parents[i].timer <= 0) {
-                parents[i].active = 0;
-                continue;
-            }
-            
-            // 随机移动
-            if (rand() % 100 < 30) {  // 30%概率改变方向
-                parents[i].direction = rand() % 4;
-            }
-            
-            // 移动
-            int new_x = parents[i].x;
-            int new_y = parents[i].y;
-            
-            switch (parents[i].direction) {
-                case 0: new_x--; break;  // 左
-                case 1: new_x++; break;  // 右
-                case 2: new_y--; break;  // 上
-                case 3: new_y++; break;  // 下
-            }
-            
-            // 检查边界和墙壁
-            if (new_x >= 0 && new_x < maps[current_map].width &&
-                new_y >= 0 && new_y < maps[current_map].height &&
-                maps[current_map].layout[new_y][new_x] != '#') {
-                parents[i].x = new_x;
-                parents[i].y = new_y;
-            }
+// 绘制地图周围的边框
+void draw_border() {
+    for (int i = 0; i < ses->view_w + 4; i++) {
+        put_cell(0, i, '#', COLOR_PAIR_WALL);
+        put_cell(ses->view_h + 3, i, '#', COLOR_PAIR_WALL);
+    }
+    for (int i = 0; i < ses->view_h + 4; i++) {
+        put_cell(i, 0, '#', COLOR_PAIR_WALL);
+        put_cell(i, ses->view_w + 3, '#', COLOR_PAIR_WALL);
+    }
+}
+
+// 重画静态层：put_* 暂时改写到层里
+void build_map_layer() {
+    MapLayer *l = &ses->layer;
+    const GameMap *map = ses->game.map;
+    Cell *back = ses->back_buf;
+    
+    ses->back_buf = l->cells;
+    for (int i = 0; i < ses->buf_rows * ses->buf_cols; i++) {
+        l->cells[i].ch = L' ';
+        l->cells[i].pair = 0;
+    }
+    draw_border();
+    draw_map();
+    ses->back_buf = back;
+    
+    l->valid = 1;
+    l->map = map;
+    l->cam_x = ses->cam_x;
+    l->cam_y = ses->cam_y;
+    l->org_cx = map->house ? map->house->org_cx : 0;
+    l->org_cy = map->house ? map->house->org_cy : 0;
+    l->w = ses->view_w + 4;
+    l->h = ses->view_h + 4;
+}
+
+// 这一行地图矩形里 [x0, x1) 要比较
+static inline void mark_span(int y, int x0, int x1) {
+    MapLayer *l = &ses->layer;
+    if (x0 < 0) {
+        x0 = 0;
+    }
+    if (x1 > l->w) {
+        x1 = l->w;
+    }
+    if (x0 < l->span_x0[y]) {
+        l->span_x0[y] = (short)x0;
+    }
+    if (x1 > l->span_x1[y]) {
+        l->span_x1[y] = (short)x1;
+    }
+}
+
+// 游戏界面的底图：静态层过期了先重画，再把 back 缓冲区恢复成静态层
+// 上一帧也是游戏界面时，地图矩形里只把上一帧的精灵换回地图，其余部分整行拷贝
+void compose_map() {
+    MapLayer *l = &ses->layer;
+    const GameMap *map = ses->game.map;
+    int rows = ses->buf_rows, cols = ses->buf_cols;
+    
+    int rebuild = !l->valid || l->map != map || l->cam_x != ses->cam_x || l->cam_y != ses->cam_y ||
+                  l->w != ses->view_w + 4 || l->h != ses->view_h + 4 ||
+                  (map->house && (l->org_cx != map->house->org_cx || l->org_cy != map->house->org_cy));
+    if (rebuild) {
+        build_map_layer();
+    }
+    
+    // 面板、性能计时面板、暂停提示和统计行都不能压在地图矩形上，终端太小时整屏比较
+    int fits = l->w + 32 <= cols && l->h + 2 <= rows;
+    if (!l->shown || rebuild || !fits) {
+        memcpy(ses->back_buf, l->cells, rows * cols * sizeof(Cell));
+        l->partial = 0;
+    } else {
+        for (int y = 0; y < l->h; y++) {
+            l->span_x0[y] = (short)l->w;
+            l->span_x1[y] = 0;
+            memcpy(&ses->back_buf[y * cols + l->w], &l->cells[y * cols + l->w], (cols - l->w) * sizeof(Cell));
         }
+        memcpy(&ses->back_buf[l->h * cols], &l->cells[l->h * cols], (rows - l->h) * cols * sizeof(Cell));
+        
+        // 窄字符盖住宽字符的一半时会改到左右相邻的格子，恢复三格
+        for (int i = 0; i < l->sprite_count; i++) {
+            int y = l->sprites[i] / cols, x = l->sprites[i] % cols;
+            int x0 = x > 0 ? x - 1 : 0;
+            int x1 = x + 2 < l->w ? x + 2 : l->w;
+            memcpy(&ses->back_buf[y * cols + x0], &l->cells[y * cols + x0], (x1 - x0) * sizeof(Cell));
+            mark_span(y, x0, x1);
+        }
+        l->partial = 1;
     }
+    l->shown = 1;
+    l->sprite_count = 0;
 }
 
-// 检查碰撞
-void check_collisions() {
-    for (int i = 0; i < 2; i++) {
-        if (parents[i].active) {
-            // 检查父母是否看到玩家（在附近）
-            int distance = abs(parents[i].x - player.x) + abs(parents[i].y - player.y);
-            
-            if (distance <= 3) {  // 如果距离小于等于3
-                GameMap *map = &maps[current_map];
-                int in_hide_area = (player.x >= map->hide_x && player.x < map->hide_x + map->hide_width &&
-                                   player.y >= map->hide_y && player.y < map->hide_y + map->hide_height);
-                
-                // 如果玩家不在隐藏区域，就被抓到
-                if (!in_hide_area) {
-                    player.state = CAUGHT;
-                    game_state = LOST;
-                    return;
-                }
-            }
+// 记下这一帧在 (y, x) 画了精灵，下一帧从静态层恢复
+void mark_sprite(int y, int x) {
+    MapLayer *l = &ses->layer;
+    if (!l->shown || l->sprite_count > MAX_NPCS) return;
+    l->sprites[l->sprite_count++] = y * ses->buf_cols + x;
+    if (l->partial) {
+        mark_span(y, x - 1, x + 2);
+    }
+}
+
+// 地图坐标换算到屏幕，不在视口里时返回 0
+int to_screen(int x, int y, int *sy, int *sx) {
+    x -= ses->cam_x;
+    y -= ses->cam_y;
+    *sy = y + 2;
+    *sx = x + 2;
+    return x >= 0 && x < ses->view_w && y >= 0 && y < ses->view_h;
+}
+
+// 绘制玩家
+void draw_player() {
+    // 根据状态选择符号
+    char symbol = 'A';
+    switch (ses->game.player.state) {
+        case PLAYING_PLANE:
+            symbol = 'A';  // 飞机
+            break;
+        case HIDING:
+            symbol = 'S';  // 学习/看电视
+            break;
+        case CAUGHT:
+            symbol = 'X';  // 被抓
+            break;
+    }
+    
+    int sy, sx;
+    if (to_screen(ses->game.player.x, ses->game.player.y, &sy, &sx)) {
+        put_cell(sy, sx, symbol, COLOR_PAIR_PLAYER);
+        mark_sprite(sy, sx);
+    }
+}
+
+// 绘制家人：父母 P，兄弟姐妹 B，老人 G，宠物 D
+void draw_npcs() {
+    static const char symbols[NPC_KIND_COUNT] = { 'P', 'B', 'G', 'D' };
+    const NpcStore *n = &ses->game.npcs;
+    
+    for (int i = 0; i < n->count; i++) {
+        int sy, sx;
+        if (to_screen(n->x[i], n->y[i], &sy, &sx)) {
+            put_cell(sy, sx, symbols[n->kind[i]], COLOR_PAIR_PARENT);
+            mark_sprite(sy, sx);
         }
     }
 }
 
+// 绘制UI
+void draw_ui() {
+    int px = ses->view_w + 6;  // 信息面板的列
+    
+    // 绘制游戏信息
+    put_str(1, px, COLOR_PAIR_TEXT, "游戏: 不要让你的父母发现你在起飞");
+    put_str(3, px, COLOR_PAIR_TEXT, "地图: %s", ses->game.map->map_name);
+    put_str(5, px, COLOR_PAIR_TEXT, "状态: %s", 
+            ses->game.player.state == PLAYING_PLANE ? "玩飞机游戏中" :
+            ses->game.player.state == HIDING ? "躲避中" : "被抓了!");
+    put_str(7, px, COLOR_PAIR_TEXT, "游戏时间: %d秒", ses->game.game_time);
+    put_str(9, px, COLOR_PAIR_TEXT, "总时间: %d/%d秒", ses->game.total_time,
+            ses->game.rules.win_time);
+    put_str(11, px, COLOR_PAIR_TEXT, "剩余父母检查: %d", 
+            ses->game.rules.check_interval - ses->game.parent_check_timer);
+    put_str(13, px, COLOR_PAIR_TEXT, "得分: %d", ses->game.player.score);
+    
+    // 绘制控制说明
+    put_str(15, px, COLOR_PAIR_TEXT, "控制:");
+    put_str(16, px, COLOR_PAIR_TEXT, "WASD/方向键 - 移动");
+    put_str(17, px, COLOR_PAIR_TEXT, "空格 - 开始/暂停");
+    put_str(18, px, COLOR_PAIR_TEXT, "M - 返回菜单");
+    put_str(19, px, COLOR_PAIR_TEXT, "Q - 退出游戏  T - 性能计时面板");
+    put_str(20, px, COLOR_PAIR_TEXT, "B - 倒退1秒  K - 存档");
+    
+    // 绘制提示
+    put_str(21, px, COLOR_PAIR_TEXT, "提示:");
+    put_str(22, px, COLOR_PAIR_TEXT, "- 父母来时躲到%s区域", ses->game.map->hint);
+    put_str(23, px, COLOR_PAIR_TEXT, "- 坚持100秒即可胜利!");
+    
+    if (ses->has_checkpoint) {
+        put_str(24, px, COLOR_PAIR_TEXT, "存档点: 第%d秒", ses->checkpoint_time);
+    }
+    
+    // 警告信息
+    if (ses->game.warning_timer > 0) {
+        put_str(25, px, COLOR_PAIR_WARNING, "警告: 父母来了! 快躲起来!");
+    }
+    if (ses->house) {
+        put_str(27, px, COLOR_PAIR_TEXT, "位置: (%d, %d)", house_abs_x(ses->house, ses->game.player.x),
+                house_abs_y(ses->house, ses->game.player.y));
+        put_str(28, px, COLOR_PAIR_TEXT, "已生成 %d 块，缓存 %d 块", ses->house->generated, ses->house->cached);
+    }
+    if (ses->replaying) {
+        put_str(26, px, COLOR_PAIR_MENU, "重放录像中 (%d倍速)", replay_speed);
+    } else if (ses->demo) {
+        put_str(26, px, COLOR_PAIR_MENU, "演示中 - 按任意键返回菜单");
+    } else if (autoplay && ses->bot && ses->bot->decisions > 0) {
+        put_str(26, px, COLOR_PAIR_MENU, "自动玩家 (每步 %.1f 毫秒)",
+                ses->bot->think_ns / 1e6 / ses->bot->decisions);
+    }
+}
+
 // 处理输入
 void handle_input(int ch) {
-    switch (game_state) {
+    switch (ses->game.state) {
         case MENU:
-            if (ch == '1') {
-                game_state = MAP_SELECTION;
+            if (ses->show_scores) {
+                if (ch == 'n' || ch == 'N') {
+                    ses->score_map = ses->score_map < map_count ? ses->score_map + 1 : 0;
+                } else if (ch == 'p' || ch == 'P') {
+                    ses->score_map = ses->score_map > 0 ? ses->score_map - 1 : map_count;
+                } else {
+                    ses->show_scores = 0;
+                }
+            } else if (ses->show_help) {
+                ses->show_help = 0;  // 说明界面按任意键返回
+            } else if (ch == '1') {
+                ses->game.state = MAP_SELECTION;
             } else if (ch == '2') {
-                // 显示游戏说明
-                clear();
-                attron(COLOR_PAIR(COLOR_PAIR_MENU));
-                mvprintw(5, 20, "游戏说明:");
-                mvprintw(7, 20, "1. 在床上玩开飞机游戏，坚持100秒即可胜利");
-                mvprintw(8, 20, "2. 父母会随机来检查，听到警告后立即躲避");
-                mvprintw(9, 20, "3. 欧美和日本地图：躲到学习区");
-                mvprintw(10, 20, "4. 维也纳艺术酒店：躲到椅子看电视区域");
-                mvprintw(11, 20, "5. 被抓到游戏结束");
-                mvprintw(13, 20, "按任意键返回菜单");
-                attroff(COLOR_PAIR(COLOR_PAIR_MENU));
-                refresh();
-                timeout(-1);
-                getch();
-                timeout(0);
+                ses->show_help = 1;
             } else if (ch == '3' || ch == 'q' || ch == 'Q') {
-                cleanup();
-                exit(0);
+                ses->quit = 1;
+            } else if (ch == '4' && !ses->screen) {
+                start_demo();  // 服务器的工作线程不跑自动玩家，远程客户端没有演示
+            } else if (ch == '5') {
+                ses->show_scores = 1;
+                if (scores) {
+                    scores_sync(scores);  // 别的进程刚打完的局
+                }
             }
             break;
             
         case MAP_SELECTION:
-            if (ch == '1') {
-                current_map = EUROPE_US;
-                init_game();
-            } else if (ch == '2') {
-                current_map = VIENNA_HOTEL;
-                init_game();
-            } else if (ch == '3') {
-                current_map = JAPAN;
-                init_game();
+            if (ch >= '1' && ch <= '9' && ses->map_page * MAPS_PER_PAGE + ch - '1' < map_count) {
+                start_game((MapType)(ses->map_page * MAPS_PER_PAGE + ch - '1'));
+            } else if (ch == 'h' || ch == 'H') {
+                start_game(MAP_HOUSE);
+            } else if ((ch == 'n' || ch == 'N') && (ses->map_page + 1) * MAPS_PER_PAGE < map_count) {
+                ses->map_page++;
+            } else if ((ch == 'p' || ch == 'P') && ses->map_page > 0) {
+                ses->map_page--;
             } else if (ch == 'm' || ch == 'M') {
-                game_state = MENU;
+                ses->game.state = MENU;
             }
             break;
             
         case PLAYING:
             if (ch == ' ' || ch == 'p' || ch == 'P') {
-                game_state = PAUSED;
+                ses->game.state = PAUSED;
             } else if (ch == 'm' || ch == 'M') {
-                game_state = MENU;
+                ses->game.state = MENU;
             } else if (ch == 'q' || ch == 'Q') {
-                cleanup();
-                exit(0);
+                ses->quit = 1;
+            } else if (ch == 'b' || ch == 'B') {
+                rewind_game();
+            } else if (ch == 'k' || ch == 'K') {
+                save_checkpoint();
             } else {
                 // 移动玩家
-                int new_x = player.x;
-                int new_y = player.y;
-                
                 switch (ch) {
                     case 'w':
                     case 'W':
                     case KEY_UP:
-                        new_y--;
+                        player_move(INPUT_UP);
                         break;
                     case 's':
                     case 'S':
                     case KEY_DOWN:
-                        new_y++;
+                        player_move(INPUT_DOWN);
                         break;
                     case 'a':
                     case 'A':
                     case KEY_LEFT:
-                        new_x--;
+                        player_move(INPUT_LEFT);
                         break;
                     case 'd':
                     case 'D':
                     case KEY_RIGHT:
-                        new_x++;
+                        player_move(INPUT_RIGHT);
                         break;
                 }
-                
-                // 检查边界和墙壁
-                if (new_x >= 0 && new_x < maps[current_map].width &&
-                    new_y >= 0 && new_y < maps[current_map].height &&
-                    maps[current_map].layout[new_y][new_x] != '#') {
-                    player.x = new_x;
-                    player.y = new_y;
-                }
             }
             break;
             
         case PAUSED:
             if (ch == ' ' || ch == 'p' || ch == 'P') {
-                game_state = PLAYING;
+                ses->game.state = PLAYING;
             } else if (ch == 'm' || ch == 'M') {
-                game_state = MENU;
+                ses->game.state = MENU;
+            } else if (ch == 'b' || ch == 'B') {
+                rewind_game();
+            } else if (ch == 'k' || ch == 'K') {
+                save_checkpoint();
             }
             break;
             
         case WIN:
         case LOST:
             if (ch == 'm' || ch == 'M') {
-                game_state = MENU;
+                ses->game.state = MENU;
             } else if (ch == 'r' || ch == 'R') {
-                init_game();
+                start_game(ses->game.map_type);
+            } else if (ch == 'b' || ch == 'B') {
+                rewind_game();
+            } else if (ch == 'c' || ch == 'C') {
+                load_checkpoint();
             }
             break;
     }
@@ -604,136 +1057,1065 @@ void handle_input(int ch) {
 
 // 绘制菜单
 void draw_menu() {
-    clear();
-    
-    attron(COLOR_PAIR(COLOR_PAIR_MENU));
-    mvprintw(5, 30, "不要让你的父母发现你在起飞");
-    mvprintw(7, 30, "==========================");
-    mvprintw(9, 30, "1. 开始游戏");
-    mvprintw(10, 30, "2. 游戏说明");
-    mvprintw(11, 30, "3. 退出游戏");
-    mvprintw(13, 30, "选择选项 (1-3):");
-    attroff(COLOR_PAIR(COLOR_PAIR_MENU));
-    
-    refresh();
+    put_str(5, 30, COLOR_PAIR_MENU, "不要让你的父母发现你在起飞");
+    put_str(7, 30, COLOR_PAIR_MENU, "==========================");
+    put_str(9, 30, COLOR_PAIR_MENU, "1. 开始游戏");
+    put_str(10, 30, COLOR_PAIR_MENU, "2. 游戏说明");
+    put_str(11, 30, COLOR_PAIR_MENU, "3. 退出游戏");
+    if (!ses->screen) {
+        put_str(12, 30, COLOR_PAIR_MENU, "4. 自动演示");
+    }
+    put_str(13, 30, COLOR_PAIR_MENU, "5. 排行榜");
+    put_str(15, 30, COLOR_PAIR_MENU, "选择选项 (1-5):");
+}
+
+// 绘制游戏说明
+void draw_help() {
+    put_str(5, 20, COLOR_PAIR_MENU, "游戏说明:");
+    put_str(7, 20, COLOR_PAIR_MENU, "1. 在床上玩开飞机游戏，坚持100秒即可胜利");
+    put_str(8, 20, COLOR_PAIR_MENU, "2. 父母会随机来检查，听到警告后立即躲避");
+    put_str(9, 20, COLOR_PAIR_MENU, "3. 欧美和日本地图：躲到学习区");
+    put_str(10, 20, COLOR_PAIR_MENU, "4. 维也纳艺术酒店：躲到椅子看电视区域或阳台");
+    put_str(11, 20, COLOR_PAIR_MENU, "5. 被抓到游戏结束");
+    put_str(13, 20, COLOR_PAIR_MENU, "按任意键返回菜单");
 }
 
 // 绘制地图选择界面
 void draw_map_selection() {
-    clear();
+    put_str(5, 30, COLOR_PAIR_MENU, "选择地图");
+    put_str(7, 30, COLOR_PAIR_MENU, "==========");
     
-    attron(COLOR_PAIR(COLOR_PAIR_MENU));
-    mvprintw(5, 30, "选择地图");
-    mvprintw(7, 30, "==========");
-    mvprintw(9, 30, "1. 欧美卧室");
-    mvprintw(10, 30, "2. 维也纳艺术酒店");
-    mvprintw(11, 30, "3. 日本和室");
-    mvprintw(13, 30, "M. 返回菜单");
-    mvprintw(15, 30, "选择地图 (1-3):");
-    attroff(COLOR_PAIR(COLOR_PAIR_MENU));
+    // 每页9张，只读当前页用到的地图
+    int first = ses->map_page * MAPS_PER_PAGE;
+    int n = map_count - first < MAPS_PER_PAGE ? map_count - first : MAPS_PER_PAGE;
+    for (int i = 0; i < n; i++) {
+        const GameMap *m = map_get(first + i);
+        put_str(9 + i, 30, COLOR_PAIR_MENU, "%d. %s", i + 1, m ? m->map_name : "(地图数据损坏)");
+    }
     
-    refresh();
+    int y = 10 + n;
+    if (map_count > MAPS_PER_PAGE) {
+        put_str(y++, 30, COLOR_PAIR_MENU, "第 %d/%d 页  N. 下一页  P. 上一页", ses->map_page + 1,
+                (map_count + MAPS_PER_PAGE - 1) / MAPS_PER_PAGE);
+    }
+    put_str(y++, 30, COLOR_PAIR_MENU, "H. 整栋房子（随机生成 %dx%d）", house_w, house_h);
+    put_str(y, 30, COLOR_PAIR_MENU, "M. 返回菜单");
+    put_str(y + 2, 30, COLOR_PAIR_MENU, "选择地图 (1-%d):", n);
 }
 
 // 绘制游戏结束界面
 void draw_game_over() {
-    clear();
-    
-    attron(COLOR_PAIR(COLOR_PAIR_MENU));
-    if (game_state == WIN) {
-        mvprintw(5, 30, "恭喜! 你成功起飞了!");
-        mvprintw(6, 30, "坚持了100秒没被父母发现!");
+    if (ses->game.state == WIN) {
+        put_str(5, 30, COLOR_PAIR_MENU, "恭喜! 你成功起飞了!");
+        put_str(6, 30, COLOR_PAIR_MENU, "坚持了100秒没被父母发现!");
     } else {
-        mvprintw(5, 30, "游戏结束! 你被父母发现了!");
-        mvprintw(6, 30, "下次要更快躲起来!");
+        put_str(5, 30, COLOR_PAIR_MENU, "游戏结束! 你被父母发现了!");
+        put_str(6, 30, COLOR_PAIR_MENU, "下次要更快躲起来!");
     }
     
-    mvprintw(8, 30, "得分: %d", player.score);
-    mvprintw(9, 30, "游戏时间: %d秒", total_time);
-    mvprintw(11, 30, "R. 重新开始");
-    mvprintw(12, 30, "M. 返回菜单");
-    attroff(COLOR_PAIR(COLOR_PAIR_MENU));
+    put_str(8, 30, COLOR_PAIR_MENU, "得分: %d", ses->game.player.score);
+    put_str(9, 30, COLOR_PAIR_MENU, "游戏时间: %d秒", ses->game.total_time);
+    if (ses->run_rank > 0) {
+        put_str(10, 30, COLOR_PAIR_WARNING, "排行榜第 %d 名!", ses->run_rank);
+    }
+    put_str(11, 30, COLOR_PAIR_MENU, "R. 重新开始");
+    put_str(12, 30, COLOR_PAIR_MENU, "B. 倒回去再试");
+    if (ses->has_checkpoint) {
+        put_str(13, 30, COLOR_PAIR_MENU, "C. 从存档点重来");
+    }
+    put_str(14, 30, COLOR_PAIR_MENU, "M. 返回菜单");
+}
+
+// 绘制一张地图的排行榜：索引里现成的前几名，和日志里有多少局无关
+void draw_scores() {
+    const GameMap *m = ses->score_map < map_count ? map_get(ses->score_map) : NULL;
+    const char *id = ses->score_map < map_count ? (m ? m->map_id : NULL) : "HOUSE";
+    const char *name = ses->score_map < map_count ? (m ? m->map_name : "(地图数据损坏)") : "整栋房子";
+    ScoreBoard b;
     
-    refresh();
+    put_str(3, 20, COLOR_PAIR_MENU, "排行榜 - %s", name);
+    put_str(4, 20, COLOR_PAIR_MENU, "==========");
+    if (!scores) {
+        put_str(6, 20, COLOR_PAIR_MENU, "无法打开战绩文件 %s", scores_path);
+    } else if (!id || !scores_board(scores, id, &b)) {
+        put_str(6, 20, COLOR_PAIR_MENU, "还没有人玩过这张地图");
+    } else {
+        put_str(6, 20, COLOR_PAIR_MENU, "共 %llu 局，胜 %llu 局", (unsigned long long)b.runs,
+                (unsigned long long)b.wins);
+        put_str(8, 20, COLOR_PAIR_MENU, "名次    得分    时间  结果  日期");
+        for (uint32_t i = 0; i < b.count; i++) {
+            char date[32];
+            time_t when = (time_t)b.top[i].when;
+            struct tm tm;
+            strftime(date, sizeof(date), "%Y-%m-%d %H:%M", localtime_r(&when, &tm));
+            put_str(9 + i, 20, COLOR_PAIR_MENU, "%3u.  %6d  %4d秒  %s  %s", i + 1, b.top[i].score,
+                    b.top[i].total_time, b.top[i].won ? "胜利" : "被抓", date);
+        }
+    }
+    put_str(21, 20, COLOR_PAIR_MENU, "N/P - 下一张/上一张地图  其他键 - 返回菜单");
 }
 
 // 绘制暂停界面
 void draw_pause() {
-    attron(COLOR_PAIR(COLOR_PAIR_WARNING));
-    mvprintw(maps[current_map].height + 5, 2, "游戏暂停 - 按空格继续");
-    attroff(COLOR_PAIR(COLOR_PAIR_WARNING));
+    put_str(ses->view_h + 5, 2, COLOR_PAIR_WARNING, "游戏暂停 - 按空格继续");
+}
+
+// 结束当前会话：保存录像，释放渲染缓冲区，恢复终端
+void session_close() {
+    stop_recording();
+    replay_free(&ses->playback);
+    house_free(ses->house);
+    ses->house = NULL;
+    free(ses->snaps);
+    ses->snaps = NULL;
+    bot_free(ses->bot);
+    ses->bot = NULL;
+    
+    free(ses->front_buf);
+    free(ses->back_buf);
+    free(ses->run_buf);
+    free(ses->layer.cells);
+    free(ses->layer.sprites);
+    free(ses->layer.span_x0);
+    free(ses->layer.span_x1);
+    free(ses->ansi_buf);
+    endwin();
 }
 
 // 清理资源
 void cleanup() {
-    // 释放地图内存
-    for (int i = 0; i < 3; i++) {
-        for (int j = 0; j < maps[i].height; j++) {
-            free(maps[i].layout[j]);
+    session_close();
+    
+    // 关闭地图包
+    maps_unload();
+    run_writer_stop();
+    scores_close(scores);
+    
+    bcast_close();
+    
+    if (trace_path && !trace_export(trace_path)) {
+        trace_path = NULL;
+    }
+}
+
+// 单调时钟，微秒
+long long now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// 每局的随机种子：时间和进程号混合，--seed 指定时固定
+uint64_t new_seed() {
+    if (seed_fixed) {
+        return seed_value;
+    }
+    return (uint64_t)time(NULL) * 1000003ULL ^ (uint64_t)now_us() ^ ((uint64_t)getpid() << 32);
+}
+
+// 开始新的一局，需要录像时同时开始录制
+// 整栋房子每局按种子重新生成，录像只记地图编号，所以这个模式不录像
+void start_game(MapType map) {
+    uint64_t seed = new_seed();
+    
+    ses->run_logged = 0;
+    ses->run_rank = 0;
+    stop_recording();
+    ses->replaying = 0;
+    if (map == MAP_HOUSE) {
+        house_free(ses->house);
+        ses->house = house_new(seed, house_w, house_h);
+        game_init_map(&ses->game, &ses->house->window, &play_rules, seed);
+        reset_snapshots();
+        return;
+    }
+    
+    if (!game_init(&ses->game, map, &play_rules, seed)) {
+        return;  // 地图数据损坏，留在原界面
+    }
+    house_free(ses->house);
+    ses->house = NULL;
+    reset_snapshots();
+    if (record_path && !ses->demo) {
+        replay_begin_record(&ses->recording, &ses->game);
+        ses->recording_active = 1;
+    }
+}
+
+// 新的一局：清空快照环和存档点，先存一份开局的快照
+void reset_snapshots() {
+    if (!ses->snaps) {
+        ses->snaps = malloc(sizeof(SnapshotRing));
+    }
+    snapshots_clear(ses->snaps);
+    snapshots_push(ses->snaps, &ses->game);
+    ses->has_checkpoint = 0;
+}
+
+// 模拟步之后调用，每隔 SNAPSHOT_INTERVAL 步存一份；分出胜负的那一步不存，倒退总是回到还在玩的时候
+void session_snapshot(Session *s) {
+    if (s->snaps && s->game.state == PLAYING && s->game.game_time % SNAPSHOT_INTERVAL == 0) {
+        snapshots_push(s->snaps, &s->game);
+    }
+}
+
+// 模拟步之后调用：一局第一次分出胜负时记进战绩，倒退以后再分出的胜负不再记
+// 重放、演示和自动玩家的对局不记
+void session_log_run(Session *s) {
+    if (!scores || s->run_logged || (s->game.state != WIN && s->game.state != LOST)) return;
+    s->run_logged = 1;
+    if (s->replaying || s->demo || autoplay) return;
+    
+    RunRecord r;
+    memset(&r, 0, sizeof(r));
+    strncpy(r.map_id, s->game.map->map_id, sizeof(r.map_id) - 1);
+    r.when = time(NULL);
+    r.seed = s->game.seed;
+    r.score = s->game.player.score;
+    r.total_time = s->game.total_time;
+    r.game_time = s->game.game_time;
+    r.won = s->game.state == WIN;
+    s->run_rank = scores_rank(scores, r.map_id, r.score);
+    
+    // 队列满了说明磁盘卡住很久了，这时才等
+    RunWriter *w = &run_writer;
+    pthread_mutex_lock(&w->lock);
+    while (w->count == RUN_QUEUE_SIZE) {
+        pthread_cond_wait(&w->cond, &w->lock);
+    }
+    w->runs[(w->head + w->count) % RUN_QUEUE_SIZE] = r;
+    w->count++;
+    pthread_cond_broadcast(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+}
+
+// 写线程：一条条追加，队列空了再把新记录算进索引，下一局问名次时就算上了这几局
+void *run_writer_main(void *arg) {
+    RunWriter *w = arg;
+    pthread_mutex_lock(&w->lock);
+    for (;;) {
+        while (w->count == 0 && !w->stop) {
+            pthread_cond_wait(&w->cond, &w->lock);
+        }
+        if (w->count == 0) break;
+        
+        RunRecord r = w->runs[w->head];
+        pthread_mutex_unlock(&w->lock);
+        scores_append(scores, &r);
+        pthread_mutex_lock(&w->lock);
+        w->head = (w->head + 1) % RUN_QUEUE_SIZE;
+        w->count--;
+        pthread_cond_broadcast(&w->cond);
+        
+        if (w->count == 0) {
+            pthread_mutex_unlock(&w->lock);
+            scores_sync(scores);
+            pthread_mutex_lock(&w->lock);
+        }
+    }
+    pthread_mutex_unlock(&w->lock);
+    return NULL;
+}
+
+void run_writer_start() {
+    if (scores && pthread_create(&run_writer.thread, NULL, run_writer_main, &run_writer) == 0) {
+        run_writer.started = 1;
+    } else {
+        scores_close(scores);  // 没有写线程就不记录
+        scores = NULL;
+    }
+}
+
+// 写完队列里剩下的记录再退出
+void run_writer_stop() {
+    if (!run_writer.started) return;
+    pthread_mutex_lock(&run_writer.lock);
+    run_writer.stop = 1;
+    pthread_cond_broadcast(&run_writer.cond);
+    pthread_mutex_unlock(&run_writer.lock);
+    pthread_join(run_writer.thread, NULL);
+    run_writer.started = 0;
+}
+
+// 恢复一份快照，丢掉比它新的，停在暂停界面
+// 录像只记操作，表达不了倒退，所以先把到现在为止的录像存下来，这一局后面不再录
+static void restore_snapshot(const void *snap) {
+    stop_recording();
+    if (!snapshot_restore(&ses->game, snap)) return;
+    
+    int keep = ses->snaps->count;
+    int tick;
+    while (keep > 0 && snapshots_get(ses->snaps, ses->snaps->count - keep, &tick) && tick > ses->game.game_time) {
+        keep--;
+    }
+    snapshots_truncate(ses->snaps, keep);
+    ses->game.state = PAUSED;
+}
+
+// B 键：退回到比现在早的最近一份快照，连按一直往前退
+void rewind_game() {
+    if (ses->replaying || !ses->snaps) return;
+    
+    int tick;
+    for (int i = 0; ; i++) {
+        const void *snap = snapshots_get(ses->snaps, i, &tick);
+        if (!snap) return;
+        if (tick < ses->game.game_time) {
+            restore_snapshot(snap);
+            return;
+        }
+    }
+}
+
+// K 键：把现在的状态存成存档点，死了以后按 C 从这里重来
+void save_checkpoint() {
+    if (ses->replaying || !ses->snaps) return;
+    snapshot_save(&ses->game, ses->checkpoint);
+    ses->has_checkpoint = 1;
+    ses->checkpoint_time = ses->game.total_time;
+}
+
+void load_checkpoint() {
+    if (ses->has_checkpoint) {
+        restore_snapshot(ses->checkpoint);
+    }
+}
+
+// 对局结束或离开时收尾并保存录像
+void stop_recording() {
+    if (!ses->recording_active) return;
+    
+    replay_finish(&ses->recording, &ses->game);
+    replay_save(&ses->recording, record_path);
+    replay_free(&ses->recording);
+    ses->recording_active = 0;
+}
+
+// 菜单上 4 键或闲置太久：随机挑一张地图让自动玩家玩
+void start_demo() {
+    idle_since = now_us();
+    ses->demo = 1;
+    start_game((MapType)(new_seed() % (uint64_t)map_count));
+    if (ses->game.state != PLAYING) {
+        ses->demo = 0;
+    }
+}
+
+// 下一次演示状态变化的时间（微秒），不需要时返回 0
+long long attract_deadline() {
+    if (ses->demo == 2) {
+        return idle_since + ATTRACT_END_US;
+    }
+    if (attract_us > 0 && ses->game.state == MENU && !ses->show_help && !ses->show_scores && !ses->replaying) {
+        return idle_since + attract_us;
+    }
+    return 0;
+}
+
+void attract_update(long long now) {
+    // 演示分出了胜负，结算界面停一会儿
+    if (ses->demo == 1 && ses->game.state != PLAYING) {
+        ses->demo = 2;
+        idle_since = now;
+    }
+    
+    long long due = attract_deadline();
+    if (!due || now < due) return;
+    if (ses->demo == 2) {
+        ses->demo = 0;
+        ses->game.state = MENU;
+        idle_since = now;
+    } else {
+        start_demo();
+    }
+    ses->state_dirty = 1;
+}
+
+// 自动玩家和人走同一条路：挑好操作以后按对应的 WASD 键
+void bot_play() {
+    static const int keys[] = { 0, 'w', 's', 'a', 'd' };
+    if (!ses->bot) {
+        ses->bot = bot_new();
+    }
+    GameInput in = bot_choose(ses->bot, &ses->game);
+    if (in != INPUT_NONE) {
+        handle_input(keys[in]);
+    }
+}
+
+// 玩家操作：重放时忽略键盘，录像时先记下再执行
+void player_move(GameInput in) {
+    if (ses->replaying) return;
+    if (ses->recording_active) {
+        replay_record_input(&ses->recording, &ses->game, in);
+    }
+    game_input(&ses->game, in);
+}
+
+// 根据游戏状态绘制一整帧
+// 每个 draw_* 分别计时，菜单这类静态界面记在 PHASE_DRAW_OTHER
+void render_frame() {
+    if (ses->game.state != PLAYING && ses->game.state != PAUSED) {
+        render_begin();
+    }
+    
+    switch (ses->game.state) {
+        case MENU:
+            if (ses->show_scores) {
+                TRACE_TIMED(PHASE_DRAW_OTHER, draw_scores());
+            } else if (ses->show_help) {
+                TRACE_TIMED(PHASE_DRAW_OTHER, draw_help());
+            } else {
+                TRACE_TIMED(PHASE_DRAW_OTHER, draw_menu());
+            }
+            break;
+            
+        case MAP_SELECTION:
+            TRACE_TIMED(PHASE_DRAW_OTHER, draw_map_selection());
+            break;
+            
+        case PLAYING:
+        case PAUSED:
+            update_camera();
+            TRACE_TIMED(PHASE_DRAW_MAP, compose_map());
+            TRACE_TIMED(PHASE_DRAW_PLAYER, draw_player());
+            TRACE_TIMED(PHASE_DRAW_NPCS, draw_npcs());
+            TRACE_TIMED(PHASE_DRAW_UI, draw_ui());
+            if (ses->game.state == PAUSED) {
+                draw_pause();
+            }
+            break;
+            
+        case WIN:
+        case LOST:
+            TRACE_TIMED(PHASE_DRAW_OTHER, draw_game_over());
+            break;
+    }
+    
+    uint64_t t0 = trace_now();
+    draw_stats();
+    if (ses->trace_overlay) {
+        draw_trace();
+    }
+    trace_record(PHASE_DRAW_OTHER, t0, trace_now());
+    render_flush();
+}
+
+// 在屏幕最底行绘制输出量和唤醒次数：ANSI 后端是字节数，ncurses 后端数不到字节，显示推送的格子数
+void draw_stats() {
+    long long now = now_us();
+    if (now - wakeup_window_start >= 1000000) {
+        long n = __atomic_exchange_n(&wakeups, 0, __ATOMIC_RELAXED);  // 服务器模式下工作线程也在加
+        wakeups_per_sec = (int)(n * 1000000 / (now - wakeup_window_start));
+        wakeup_window_start = now;
+    }
+    
+    if (ses->bytes_last_frame >= 0) {
+        put_str(ses->buf_rows - 1, 0, COLOR_PAIR_TEXT, "输出: %ld 字节/帧  唤醒: %d 次/秒",
+                ses->bytes_last_frame, wakeups_per_sec);
+    } else {
+        put_str(ses->buf_rows - 1, 0, COLOR_PAIR_TEXT, "输出: %ld 格/帧  唤醒: %d 次/秒",
+                ses->cells_last_frame, wakeups_per_sec);
+    }
+}
+
+// 在屏幕右上角绘制每个阶段最近的耗时中位数和 p99（微秒）
+void draw_trace() {
+    TraceStats st[PHASE_COUNT];
+    trace_summary(st);
+    
+    int x = ses->buf_cols - 32;
+    put_str(0, x, COLOR_PAIR_MENU, "阶段(微秒)");
+    put_str(0, x + 12, COLOR_PAIR_MENU, "%9s %9s", "p50", "p99");
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        if (st[p].samples == 0) {
+            put_str(1 + p, x, COLOR_PAIR_MENU, "%-11s %9s %9s", trace_phase_names[p], "-", "-");
+        } else {
+            put_str(1 + p, x, COLOR_PAIR_MENU, "%-11s %9.1f %9.1f", trace_phase_names[p],
+                    st[p].p50 / 1000.0, st[p].p99 / 1000.0);
+        }
+    }
+}
+
+// 渲染基准：输出到管道，终端固定 120x40，测每张地图上每帧的耗时和输出字节数
+// 每种情况跑 RENDER_BENCH_FRAMES 帧：diff 是平常的增量更新，full 是每帧都整屏重绘；
+// ncurses 和 ANSI 两个后端各跑一遍，比较输出量
+// 输出格式和 bench 程序相同，--json 时每行一个 JSON 对象
+#define RENDER_BENCH_FRAMES 1000
+
+int run_render_bench(int json) {
+    static const int npc_counts[] = { 0, 8, 128 };
+    
+    setenv("LINES", "40", 1);
+    setenv("COLUMNS", "120", 1);
+    if (!setlocale(LC_ALL, "zh_CN.UTF-8")) {
+        setlocale(LC_ALL, "");
+    }
+    // 终端输出接到管道上，每帧读空管道就知道这一帧写了多少字节
+    int pfd[2];
+    if (pipe2(pfd, O_CLOEXEC) < 0) {
+        perror("pipe");
+        return 0;
+    }
+    fcntl(pfd[0], F_SETFL, O_NONBLOCK);
+    fcntl(pfd[1], F_SETPIPE_SZ, 1 << 20);
+    FILE *out = fdopen(pfd[1], "w");
+    FILE *in = fopen("/dev/null", "r");
+    if (!out || !in || !newterm("xterm-256color", out, in)) {
+        fprintf(stderr, "无法创建 xterm-256color 终端\n");
+        return 0;
+    }
+    ses->out = out;  // ANSI 后端也写到这里
+    ses->count_fd = pfd[0];
+    setup_screen();
+    
+    for (int m = 0; m < map_count; m++) {
+        if (!map_get(m)) continue;
+        
+        for (size_t c = 0; c < sizeof(npc_counts) / sizeof(npc_counts[0]); c++) {
+            int n = npc_counts[c];
+            GameRules r = play_rules;
+            r.max_npcs = n;
+            r.check_interval = 1 << 30;
+            r.parent_time = 1 << 30;
+            r.win_time = 1 << 30;
+            game_init(&ses->game, (MapType)m, &r, 20240101);
+            for (int k = 0; k < n; k++) {
+                npc_spawn(&ses->game, (NpcKind)(k % NPC_KIND_COUNT));
+            }
+            
+            for (int mode = 0; mode < 4; mode++) {
+                int full = mode & 1;
+                if (!full) {
+                    // 换后端时先整屏画一帧，两边对终端内容的记录才一致
+                    ses->ansi = mode >> 1;
+                    render_resize();
+                    render_frame();
+                }
+                long long bytes = 0;
+                uint64_t t0 = trace_now();
+                for (int f = 0; f < RENDER_BENCH_FRAMES; f++) {
+                    game_step(&ses->game, INPUT_NONE);
+                    ses->game.state = PLAYING;
+                    if (full) {
+                        render_resize();
+                    }
+                    render_frame();
+                    bytes += ses->bytes_last_frame;
+                }
+                double frame_ns = (double)(trace_now() - t0) / RENDER_BENCH_FRAMES;
+                
+                // 各阶段取中位数，最近 TRACE_WINDOW 帧都是这一种情况
+                TraceStats st[PHASE_COUNT];
+                trace_summary(st);
+                const char *kind = full ? "full" : "diff";
+                const char *backend = ses->ansi ? "ansi" : "ncurses";
+                if (json) {
+                    printf("{\"bench\":\"render\",\"map\":\"%s\",\"npcs\":%d,\"backend\":\"%s\",\"mode\":\"%s\","
+                           "\"frame_ns\":%.0f,\"draw_map_ns\":%u,\"draw_ui_ns\":%u,\"flush_ns\":%u,"
+                           "\"refresh_ns\":%u,\"bytes_per_frame\":%.1f}\n",
+                           ses->game.map->map_id, n, backend, kind, frame_ns, st[PHASE_DRAW_MAP].p50,
+                           st[PHASE_DRAW_UI].p50, st[PHASE_FLUSH].p50, st[PHASE_REFRESH].p50,
+                           (double)bytes / RENDER_BENCH_FRAMES);
+                } else {
+                    printf("render %-14s %4d 人 %-7s %s  帧 %9.0f ns  地图 %7u ns  界面 %7u ns  "
+                           "比较 %7u ns  refresh %8u ns  %8.1f 字节/帧\n",
+                           ses->game.map->map_id, n, backend, kind, frame_ns, st[PHASE_DRAW_MAP].p50,
+                           st[PHASE_DRAW_UI].p50, st[PHASE_FLUSH].p50, st[PHASE_REFRESH].p50,
+                           (double)bytes / RENDER_BENCH_FRAMES);
+                }
+            }
         }
-        free(maps[i].layout);
     }
     
     endwin();
+    return 1;
+}
+
+// 模拟步定时器每 step_us 微秒到期一次，step_us 为 0 时关闭
+void set_tick_timer(int fd, int step_us) {
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    if (step_us > 0) {
+        its.it_interval.tv_sec = step_us / 1000000;
+        its.it_interval.tv_nsec = (step_us % 1000000) * 1000L;
+        its.it_value = its.it_interval;
+    }
+    timerfd_settime(fd, 0, &its, NULL);
+}
+
+// 取完当前会话所有已缓冲的按键（窗口大小变化时 poll 被信号打断，这里会读到 KEY_RESIZE）
+void session_read_keys() {
+    int ch;
+    while ((ch = getch()) != ERR) {
+        idle_since = now_us();
+        if (ch == KEY_RESIZE) {
+            render_resize();
+        } else if (ses->demo) {
+            ses->demo = 0;  // 演示时按任意键回到菜单
+            ses->game.state = MENU;
+        } else if (ch == 't' || ch == 'T') {
+            ses->trace_overlay = !ses->trace_overlay;
+        } else {
+            handle_input(ch);
+        }
+        ses->state_dirty = 1;
+    }
+}
+
+// 服务器模式：一个进程托管很多局，客户端从 Unix 域套接字连进来，比如
+//   socat -,raw,echo=0 UNIX-CONNECT:/tmp/plane.sock
+// 所有会话共用同一份 mmap 的地图包，每个连接有自己的 GameContext 和 newterm 建的 SCREEN
+// 主线程只管 accept，新连接轮流交给工作线程；每个工作线程一个 epoll，等自己那些连接的按键、
+// 新连接的管道和一个公用的模拟步定时器（有人在玩时才开）
+// 模拟步不碰 ncurses，各线程并行跑；ncurses 不是线程安全的，处理按键和渲染都在 curses_lock 里，
+// 先 set_term 切到会话的 SCREEN 再调用和本地终端相同的函数
+#define MAX_WORKERS 64
+
+typedef struct {
+    pthread_t thread;
+    int epfd;
+    int tfd;                  // 模拟步定时器
+    int pipe_rd, pipe_wr;     // 主线程把新连接的 fd 写进来
+    Session *sessions;        // 只由这个线程访问
+} Worker;
+
+Worker workers[MAX_WORKERS];
+int worker_count = 2;
+int server_cols = 100, server_rows = 30;  // 套接字没有窗口大小，所有客户端按这个大小画
+pthread_mutex_t curses_lock = PTHREAD_MUTEX_INITIALIZER;
+Session *idle_sessions = NULL;  // 断开的连接留下的 SCREEN，由 curses_lock 保护
+int devnull_fd = -1;
+
+// 切换到一个会话，调用者持有 curses_lock
+void session_enter(Session *s) {
+    ses = s;
+    set_term(s->screen);
+}
+
+// 为新连接建立会话，失败时关闭连接
+// 有空闲的 SCREEN 就把新连接 dup2 到它原来的 fd 上接着用，否则用 newterm 新建一个
+void session_open(Worker *w, int fd) {
+    char num[16];
+    
+    pthread_mutex_lock(&curses_lock);
+    Session *s = idle_sessions;
+    if (s) {
+        idle_sessions = s->next;
+        dup2(fd, fileno(s->in));
+        dup2(fd, fileno(s->out));
+        close(fd);
+    } else {
+        s = calloc(1, sizeof(Session));
+        s->in = fdopen(fd, "r");
+        s->out = fdopen(dup(fd), "w");
+        // ncurses 在终端没有窗口大小时读这两个环境变量
+        snprintf(num, sizeof(num), "%d", server_cols);
+        setenv("COLUMNS", num, 1);
+        snprintf(num, sizeof(num), "%d", server_rows);
+        setenv("LINES", num, 1);
+        if (s->in && s->out) {
+            s->screen = newterm("xterm-256color", s->out, s->in);
+        }
+        if (!s->screen) {
+            pthread_mutex_unlock(&curses_lock);
+            if (s->in) fclose(s->in);
+            if (s->out) fclose(s->out);
+            if (!s->in) close(fd);
+            free(s);
+            return;
+        }
+    }
+    
+    s->fd = fileno(s->in);
+    s->state_dirty = 1;
+    session_enter(s);
+    set_escdelay(25);  // 单独的 ESC 不能在锁里等太久
+    flushinp();        // 丢掉上一个连接没读完的按键
+    setup_screen();
+    pthread_mutex_unlock(&curses_lock);
+    
+    struct epoll_event ev = { .events = EPOLLIN | EPOLLRDHUP, .data.ptr = s };
+    epoll_ctl(w->epfd, EPOLL_CTL_ADD, s->fd, &ev);
+    s->next = w->sessions;
+    w->sessions = s;
+}
+
+// 客户端断开或选了退出：恢复它的终端，关掉连接，会话放回空闲表，调用前已经从链表里摘下
+// 不调用 delscreen：ncurses 6.4 的 delscreen 会把其他 SCREEN 的窗口也一起释放
+void session_drop(Worker *w, Session *s) {
+    epoll_ctl(w->epfd, EPOLL_CTL_DEL, s->fd, NULL);
+    
+    pthread_mutex_lock(&curses_lock);
+    session_enter(s);
+    session_close();
+    ses = &console;
+    
+    // fd 换成 /dev/null，客户端那一头就关掉了，fd 号和 SCREEN 留着给下一个连接
+    dup2(devnull_fd, fileno(s->in));
+    dup2(devnull_fd, fileno(s->out));
+    
+    SCREEN *screen = s->screen;
+    FILE *in = s->in, *out = s->out;
+    memset(s, 0, sizeof(*s));
+    s->screen = screen;
+    s->in = in;
+    s->out = out;
+    s->next = idle_sessions;
+    idle_sessions = s;
+    pthread_mutex_unlock(&curses_lock);
+}
+
+void *worker_main(void *arg) {
+    Worker *w = arg;
+    struct epoll_event evs[64];
+    int timer_on = 0;
+    
+    while (1) {
+        int n = epoll_wait(w->epfd, evs, 64, -1);
+        if (n > 0) {
+            __atomic_add_fetch(&wakeups, 1, __ATOMIC_RELAXED);
+        }
+        
+        for (int i = 0; i < n; i++) {
+            void *p = evs[i].data.ptr;
+            
+            if (p == &w->tfd) {
+                // 模拟步：不碰 ncurses，不用加锁
+                uint64_t expired;
+                if (read(w->tfd, &expired, sizeof(expired)) != sizeof(expired)) continue;
+                if (expired > MAX_CATCHUP_TICKS) {
+                    expired = MAX_CATCHUP_TICKS;
+                }
+                for (Session *s = w->sessions; s; s = s->next) {
+                    if (s->game.state != PLAYING) continue;
+                    for (uint64_t k = 0; k < expired && s->game.state == PLAYING; k++) {
+                        update_game(&s->game);
+                        session_snapshot(s);
+                        session_log_run(s);
+                    }
+                    s->state_dirty = 1;
+                }
+            } else if (p == &w->pipe_rd) {
+                int fds[16];
+                ssize_t len = read(w->pipe_rd, fds, sizeof(fds));
+                for (int k = 0; k < len / (ssize_t)sizeof(int); k++) {
+                    session_open(w, fds[k]);
+                }
+            } else {
+                Session *s = p;
+                if (evs[i].events & (EPOLLHUP | EPOLLERR | EPOLLRDHUP)) {
+                    s->quit = 1;
+                    continue;
+                }
+                pthread_mutex_lock(&curses_lock);
+                session_enter(s);
+                session_read_keys();
+                pthread_mutex_unlock(&curses_lock);
+            }
+        }
+        
+        // 关掉退出的会话，重绘有变化的会话，有人在玩时才开定时器
+        int playing = 0;
+        for (Session **link = &w->sessions; *link; ) {
+            Session *s = *link;
+            if (s->quit) {
+                *link = s->next;
+                session_drop(w, s);
+                continue;
+            }
+            if (s->state_dirty) {
+                pthread_mutex_lock(&curses_lock);
+                session_enter(s);
+                render_frame();
+                s->state_dirty = 0;
+                pthread_mutex_unlock(&curses_lock);
+            }
+            playing |= s->game.state == PLAYING;
+            link = &s->next;
+        }
+        if (playing != timer_on) {
+            timer_on = playing;
+            set_tick_timer(w->tfd, playing ? game_speed : 0);
+        }
+    }
+    return NULL;
+}
+
+int run_server(const char *path) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "%s: 路径太长\n", path);
+        return 0;
+    }
+    strcpy(addr.sun_path, path);
+    
+    int lfd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    unlink(path);
+    if (lfd < 0 || bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(lfd, 64) != 0) {
+        perror(path);
+        return 0;
+    }
+    
+    // 客户端断开后写终端不能杀掉整个服务器
+    signal(SIGPIPE, SIG_IGN);
+    devnull_fd = open("/dev/null", O_RDWR | O_CLOEXEC);
+    if (!setlocale(LC_ALL, "zh_CN.UTF-8")) {
+        setlocale(LC_ALL, "");
+    }
+    
+    // map_get 第一次读一张地图时会写缓存，在启动工作线程之前全部读好，之后只读
+    for (int i = 0; i < map_count; i++) {
+        map_get(i);
+    }
+    
+    wakeup_window_start = now_us();
+    for (int i = 0; i < worker_count; i++) {
+        Worker *w = &workers[i];
+        int p[2];
+        if (pipe2(p, O_CLOEXEC) != 0) {
+            perror("pipe");
+            return 0;
+        }
+        w->pipe_rd = p[0];
+        w->pipe_wr = p[1];
+        w->epfd = epoll_create1(EPOLL_CLOEXEC);
+        w->tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = &w->tfd };
+        epoll_ctl(w->epfd, EPOLL_CTL_ADD, w->tfd, &ev);
+        ev.data.ptr = &w->pipe_rd;
+        epoll_ctl(w->epfd, EPOLL_CTL_ADD, w->pipe_rd, &ev);
+        pthread_create(&w->thread, NULL, worker_main, w);
+    }
+    fprintf(stderr, "在 %s 等待连接（%d 个工作线程，终端 %dx%d）\n", path, worker_count, server_cols,
+            server_rows);
+            
+    for (int next = 0; ; next = (next + 1) % worker_count) {
+        int fd = accept4(lfd, NULL, NULL, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED || errno == EMFILE || errno == ENFILE) continue;
+            perror("accept");
+            return 0;
+        }
+        if (write(workers[next].pipe_wr, &fd, sizeof(fd)) != sizeof(fd)) {
+            close(fd);
+        }
+    }
 }
 
 // 主函数
-int main() {
-    // 初始化随机种子
-    srand(time(NULL));
+int main(int argc, char *argv[]) {
+    // 解析参数
+    int bench = 0, bench_json = 0;
+    const char *server_path = NULL;
+    const char *broadcast_path = NULL;
+    play_rules = default_rules;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc) {
+            render_fps = atoi(argv[++i]);
+            if (render_fps < 1) {
+                render_fps = 1;
+            }
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed_fixed = 1;
+            seed_value = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            record_path = argv[++i];
+        } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            if (!replay_load(&ses->playback, argv[++i])) {
+                fprintf(stderr, "无法读取录像: %s\n", argv[i]);
+                return 1;
+            }
+            ses->replaying = 1;
+        } else if (strcmp(argv[i], "--speed") == 0 && i + 1 < argc) {
+            replay_speed = atoi(argv[++i]);
+            if (replay_speed < 1) {
+                replay_speed = 1;
+            }
+        } else if (strcmp(argv[i], "--maps") == 0 && i + 1 < argc) {
+            maps_path = argv[++i];
+        } else if (strcmp(argv[i], "--family") == 0 && i + 1 < argc) {
+            play_rules.max_npcs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            trace_path = argv[++i];
+        } else if (strcmp(argv[i], "--server") == 0 && i + 1 < argc) {
+            server_path = argv[++i];
+        } else if (strcmp(argv[i], "--house-size") == 0 && i + 1 < argc) {
+            if (sscanf(argv[++i], "%dx%d", &house_w, &house_h) != 2) {
+                house_w = house_h = 4096;
+            }
+        } else if (strcmp(argv[i], "--autoplay") == 0) {
+            autoplay = 1;
+        } else if (strcmp(argv[i], "--attract") == 0 && i + 1 < argc) {
+            attract_us = atoll(argv[++i]) * 1000000;
+        } else if (strcmp(argv[i], "--broadcast") == 0 && i + 1 < argc) {
+            broadcast_path = argv[++i];
+        } else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+            worker_count = atoi(argv[++i]);
+            if (worker_count < 1) {
+                worker_count = 1;
+            } else if (worker_count > MAX_WORKERS) {
+                worker_count = MAX_WORKERS;
+            }
+        } else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+            if (sscanf(argv[++i], "%dx%d", &server_cols, &server_rows) != 2 || server_cols < 20 ||
+                server_rows < 10) {
+                server_cols = 100;
+                server_rows = 30;
+            }
+        } else if (strcmp(argv[i], "--scores") == 0 && i + 1 < argc) {
+            scores_path = argv[++i];
+        } else if (strcmp(argv[i], "--ansi") == 0) {
+            ansi_backend = 1;
+        } else if (strcmp(argv[i], "--bench") == 0) {
+            bench = 1;
+        } else if (strcmp(argv[i], "--json") == 0) {
+            bench_json = 1;
+        }
+    }
+    
+    // 服务器模式的各局共用同一个录像文件名，会互相覆盖
+    if (server_path && (record_path || ses->replaying)) {
+        fprintf(stderr, "服务器模式不支持 --record 和 --replay\n");
+        return 1;
+    }
+    
+    // 打开地图包
+    const char *err;
+    if (!maps_path) {
+        maps_use_builtin(builtin_maps, builtin_map_count);
+    } else if (!maps_load(maps_path, &err)) {
+        fprintf(stderr, "%s: %s\n", maps_path, err);
+        return 1;
+    }
+    
+    if (bench) {
+        int ok = run_render_bench(bench_json);
+        maps_unload();
+        return ok ? 0 : 1;
+    }
+    
+    scores = scores_open(scores_path, &err);
+    if (!scores) {
+        fprintf(stderr, "%s: %s，不记录战绩\n", scores_path, err);
+    }
+    run_writer_start();
+    
+    // 服务器模式不录像也不重放，每个客户端从菜单开始
+    if (server_path) {
+        int ok = run_server(server_path);
+        run_writer_stop();
+        scores_close(scores);
+        maps_unload();
+        return ok ? 0 : 1;
+    }
+    
+    // 重放录像时跳过菜单直接开始
+    if (ses->replaying && !replay_start(&ses->playback_cursor, &ses->playback, &ses->game)) {
+        fprintf(stderr, "录像用到的地图不在地图包里\n");
+        return 1;
+    }
+    if (ses->replaying) {
+        reset_snapshots();
+    }
+    
+    if (broadcast_path && !bcast_open(broadcast_path)) {
+        fprintf(stderr, "无法监听直播套接字: %s\n", broadcast_path);
+        return 1;
+    }
     
     // 初始化ncurses
     init_ncurses();
     
-    // 初始化地图
-    init_maps();
+    // 主游戏循环：阻塞等待按键或模拟步定时器
+    // 定时器只在 PLAYING 时开启，其余静态界面完全休眠直到有按键
+    int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    int timer_on = 0;
+    long long frame_us = 1000000 / render_fps;
+    long long next_render = 0;
+    wakeup_window_start = now_us();
+    idle_since = wakeup_window_start;
     
-    // 主游戏循环
-    int ch;
-    while (1) {
-        clear();
+    while (!ses->quit) {
+        // 只在 PLAYING 时推进模拟
+        if ((ses->game.state == PLAYING) != timer_on) {
+            timer_on = (ses->game.state == PLAYING);
+            set_tick_timer(tfd, !timer_on ? 0 : ses->replaying ? game_speed / replay_speed : game_speed);
+        }
         
-        // 根据游戏状态绘制不同界面
-        switch (game_state) {
-            case MENU:
-                draw_menu();
-                break;
-                
-            case MAP_SELECTION:
-                draw_map_selection();
-                break;
-                
-            case PLAYING:
-                draw_map();
-                draw_player();
-                draw_parents();
-                draw_ui();
-                update_game();
-                break;
-                
-            case PAUSED:
-                draw_map();
-                draw_player();
-                draw_parents();
-                draw_ui();
-                draw_pause();
-                break;
-                
-            case WIN:
-            case LOST:
-                draw_game_over();
-                break;
+        // 状态变了就渲染，但不超过最高渲染帧率
+        int wait_ms = -1;
+        if (ses->state_dirty) {
+            long long now = now_us();
+            if (now >= next_render) {
+                render_frame();
+                bcast_service();
+                ses->state_dirty = 0;
+                next_render = now + frame_us;
+            } else {
+                wait_ms = (int)((next_render - now + 999) / 1000);
+            }
+        }
+        long long due = attract_deadline();
+        if (due) {
+            long long now = now_us();
+            int ms = due > now ? (int)((due - now + 999) / 1000) : 0;
+            if (wait_ms < 0 || ms < wait_ms) {
+                wait_ms = ms;
+            }
         }
         
-        // 获取输入
-        ch = getch();
-        if (ch != ERR) {
-            handle_input(ch);
+        // 观众的套接字也一起等：新连接，或者没写完的观众又能写了
+        struct pollfd fds[2 + 1 + BCAST_MAX_VIEWERS] = {
+            { STDIN_FILENO, POLLIN, 0 },
+            { tfd, POLLIN, 0 },
+        };
+        int nfds = 2 + bcast_pollfds(fds + 2);
+        uint64_t t0 = trace_now();
+        int ready = poll(fds, nfds, wait_ms);
+        trace_record(PHASE_SLEEP, t0, trace_now());
+        if (ready > 0) {
+            wakeups++;
         }
+        bcast_service();
         
-        // 控制游戏速度
-        usleep(game_speed);
-        refresh();
+        // 模拟步：按定时器到期次数补跑，卡顿后最多补 MAX_CATCHUP_TICKS 步
+        uint64_t expired;
+        if (read(tfd, &expired, sizeof(expired)) == sizeof(expired)) {
+            if (expired > MAX_CATCHUP_TICKS) {
+                expired = MAX_CATCHUP_TICKS;
+            }
+            for (uint64_t i = 0; i < expired && ses->game.state == PLAYING; i++) {
+                t0 = trace_now();
+                if (!ses->replaying) {
+                    if (autoplay || ses->demo) {
+                        bot_play();
+                    }
+                    update_game(&ses->game);
+                } else if (!replay_advance(&ses->playback_cursor, &ses->game)) {
+                    // 录像放完：还没分出胜负就停在暂停界面，可以接着自己玩
+                    ses->replaying = 0;
+                    if (ses->game.state == PLAYING) {
+                        ses->game.state = PAUSED;
+                    }
+                }
+                session_snapshot(ses);
+                session_log_run(ses);
+                trace_record(PHASE_UPDATE, t0, trace_now());
+            }
+            ses->state_dirty = 1;
+        }
+        
+        t0 = trace_now();
+        session_read_keys();
+        trace_record(PHASE_INPUT, t0, trace_now());
+        attract_update(now_us());
+        
+        // 分出胜负或回到菜单时保存录像
+        if (ses->recording_active && ses->game.state != PLAYING && ses->game.state != PAUSED) {
+            stop_recording();
+        }
     }
     
     cleanup();
@@ -0,0 +1,225 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "replay.h"
+
+#define REPLAY_MAGIC "PLRP"
+#define REPLAY_VERSION 5  // 游戏规则变化后旧录像不能重放，版本号跟着加
+#define REPLAY_HEADER_SIZE 44
+#define REPLAY_RESULT_SIZE 12
+
+static void push_byte(Replay *r, unsigned char b) {
+    if (r->len == r->cap) {
+        r->cap = r->cap ? r->cap * 2 : 256;
+        r->events = realloc(r->events, r->cap);
+    }
+    r->events[r->len++] = b;
+}
+
+// 写一个事件：步数差小于31时整个事件只占一个字节
+static void push_event(Replay *r, int delta, int input) {
+    if (delta < 31) {
+        push_byte(r, (unsigned char)(delta << 3 | input));
+        return;
+    }
+    push_byte(r, (unsigned char)(31 << 3 | input));
+    unsigned int rest = delta - 31;
+    while (rest >= 0x80) {
+        push_byte(r, (unsigned char)(rest | 0x80));
+        rest >>= 7;
+    }
+    push_byte(r, (unsigned char)rest);
+}
+
+// 读一个事件，数据不完整时返回 0
+static int read_event(const Replay *r, size_t *pos, int *delta, int *input) {
+    if (*pos >= r->len) return 0;
+    
+    unsigned char b = r->events[(*pos)++];
+    *input = b & 7;
+    *delta = b >> 3;
+    if (*delta == 31) {
+        unsigned int rest = 0;
+        int shift = 0;
+        unsigned char v;
+        do {
+            if (*pos >= r->len || shift > 28) return 0;
+            v = r->events[(*pos)++];
+            rest |= (unsigned int)(v & 0x7f) << shift;
+            shift += 7;
+        } while (v & 0x80);
+        *delta += rest;
+    }
+    return 1;
+}
+
+void replay_begin_record(Replay *r, const GameContext *g) {
+    memset(r, 0, sizeof(*r));
+    r->map = g->map_type;
+    r->rules = g->rules;
+    r->seed = g->seed;
+    r->last_tick = g->game_time;
+}
+
+void replay_record_input(Replay *r, const GameContext *g, GameInput in) {
+    if (r->finished || g->state != PLAYING || in == INPUT_NONE) return;
+    
+    push_event(r, g->game_time - r->last_tick, in);
+    r->last_tick = g->game_time;
+}
+
+void replay_finish(Replay *r, const GameContext *g) {
+    if (r->finished) return;
+    
+    push_event(r, g->game_time - r->last_tick, REPLAY_END);
+    r->last_tick = g->game_time;
+    r->finished = 1;
+    // 中途暂停或回到菜单的对局按未结束记录
+    r->result_state = (g->state == WIN || g->state == LOST) ? g->state : PLAYING;
+    r->result_score = g->player.score;
+    r->result_ticks = g->game_time;
+}
+
+void replay_free(Replay *r) {
+    free(r->events);
+    memset(r, 0, sizeof(*r));
+}
+
+static void put_u32(unsigned char *p, uint32_t v) {
+    for (int i = 0; i < 4; i++) {
+        p[i] = (unsigned char)(v >> (8 * i));
+    }
+}
+
+static uint32_t get_u32(const unsigned char *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+int replay_save(const Replay *r, const char *path) {
+    unsigned char head[REPLAY_HEADER_SIZE];
+    unsigned char tail[REPLAY_RESULT_SIZE];
+    
+    memset(head, 0, sizeof(head));
+    memcpy(head, REPLAY_MAGIC, 4);
+    head[4] = REPLAY_VERSION;
+    head[5] = (unsigned char)r->map;
+    head[6] = (unsigned char)(r->map >> 8);
+    put_u32(head + 8, (uint32_t)r->seed);
+    put_u32(head + 12, (uint32_t)(r->seed >> 32));
+    put_u32(head + 16, r->rules.check_interval);
+    put_u32(head + 20, r->rules.spawn_chance);
+    put_u32(head + 24, r->rules.parent_time);
+    put_u32(head + 28, r->rules.catch_distance);
+    put_u32(head + 32, r->rules.win_time);
+    put_u32(head + 36, r->rules.max_npcs);
+    put_u32(head + 40, (uint32_t)r->len);
+    
+    put_u32(tail, r->result_state);
+    put_u32(tail + 4, r->result_score);
+    put_u32(tail + 8, r->result_ticks);
+    
+    FILE *f = fopen(path, "wb");
+    if (!f) return 0;
+    int ok = fwrite(head, sizeof(head), 1, f) == 1 &&
+             (r->len == 0 || fwrite(r->events, r->len, 1, f) == 1) &&
+             fwrite(tail, sizeof(tail), 1, f) == 1;
+    if (fclose(f) != 0) {
+        ok = 0;
+    }
+    return ok;
+}
+
+int replay_load(Replay *r, const char *path) {
+    unsigned char head[REPLAY_HEADER_SIZE];
+    unsigned char tail[REPLAY_RESULT_SIZE];
+    
+    memset(r, 0, sizeof(*r));
+    FILE *f = fopen(path, "rb");
+    if (!f) return 0;
+    
+    if (fread(head, sizeof(head), 1, f) != 1 || memcmp(head, REPLAY_MAGIC, 4) != 0 ||
+        head[4] != REPLAY_VERSION) {
+        fclose(f);
+        return 0;
+    }
+    
+    r->map = (MapType)(head[5] | head[6] << 8);
+    r->seed = (uint64_t)get_u32(head + 8) | (uint64_t)get_u32(head + 12) << 32;
+    r->rules.check_interval = (int)get_u32(head + 16);
+    r->rules.spawn_chance = (int)get_u32(head + 20);
+    r->rules.parent_time = (int)get_u32(head + 24);
+    r->rules.catch_distance = (int)get_u32(head + 28);
+    r->rules.win_time = (int)get_u32(head + 32);
+    r->rules.max_npcs = (int)get_u32(head + 36);
+    
+    // 事件流长度来自文件，先和文件大小核对再分配，坏文件不会要几个GB的内存
+    struct stat st;
+    uint64_t len = get_u32(head + 40);
+    if (fstat(fileno(f), &st) != 0 ||
+        (uint64_t)st.st_size < REPLAY_HEADER_SIZE + REPLAY_RESULT_SIZE + len) {
+        fclose(f);
+        return 0;
+    }
+    r->len = r->cap = len;
+    r->events = malloc(r->len ? r->len : 1);
+    
+    int ok = (r->len == 0 || fread(r->events, r->len, 1, f) == 1) &&
+             fread(tail, sizeof(tail), 1, f) == 1;
+    fclose(f);
+    if (!ok) {
+        replay_free(r);
+        return 0;
+    }
+    
+    r->result_state = (int)get_u32(tail);
+    r->result_score = (int)get_u32(tail + 4);
+    r->result_ticks = (int)get_u32(tail + 8);
+    r->finished = 1;
+    return 1;
+}
+
+// 读出下一个事件，事件流坏了就当作结束
+static void cursor_next(ReplayCursor *c) {
+    int delta, input;
+    if (read_event(c->replay, &c->pos, &delta, &input) && input <= REPLAY_END) {
+        c->next_tick += delta;
+        c->next_input = (GameInput)input;
+    } else {
+        c->next_input = (GameInput)REPLAY_END;
+    }
+}
+
+int replay_start(ReplayCursor *c, const Replay *r, GameContext *g) {
+    if (!game_init(g, r->map, &r->rules, r->seed)) return 0;
+    
+    c->replay = r;
+    c->pos = 0;
+    c->next_tick = 0;
+    cursor_next(c);
+    return 1;
+}
+
+int replay_advance(ReplayCursor *c, GameContext *g) {
+    // 先执行这一步之前录下的所有操作
+    while ((int)c->next_input != REPLAY_END && c->next_tick <= g->game_time) {
+        game_input(g, c->next_input);
+        cursor_next(c);
+    }
+    
+    if (g->state != PLAYING) return 0;
+    if ((int)c->next_input == REPLAY_END && c->next_tick <= g->game_time) return 0;
+    
+    update_game(g);
+    return 1;
+}
+
+int replay_run(const Replay *r, GameContext *g) {
+    ReplayCursor c;
+    if (!replay_start(&c, r, g)) return 0;
+    while (replay_advance(&c, g)) {
+    }
+    return (int)g->state == r->result_state && g->player.score == r->result_score &&
+           g->game_time == r->result_ticks;
+}
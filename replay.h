@@ -0,0 +1,66 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "game.h"
+
+// 录像：种子 + 每步的玩家操作，重放时得到完全相同的对局
+//
+// 文件格式（小端）:
+//   0   4  "PLRP"
+//   4   1  版本 (5)
+//   5   2  地图编号（地图包里的第几张）
+//   7   1  保留
+//   8   8  种子
+//   16  24 GameRules，6个 int32
+//   40  4  事件流长度 N
+//   44  N  事件流
+//   44+N 12 结果：状态、得分、总步数，各 int32
+//
+// 事件流每个事件一个字节：低3位是操作 (GameInput，7 表示结束)，
+// 高5位是距上一个事件经过的步数；步数 >= 31 时高5位写 31，后面跟一个变长整数
+
+#define REPLAY_END 7
+
+typedef struct {
+    MapType map;
+    GameRules rules;
+    uint64_t seed;
+    unsigned char *events;
+    size_t len, cap;
+    int last_tick;      // 上一个事件发生在第几步
+    int finished;
+    // 录制结束时的结果，重放后用来核对
+    int result_state;
+    int result_score;
+    int result_ticks;
+} Replay;
+
+// 重放进度
+typedef struct {
+    const Replay *replay;
+    size_t pos;
+    int next_tick;          // 下一个事件在第几步
+    GameInput next_input;   // REPLAY_END 表示没有更多事件
+} ReplayCursor;
+
+// 录制：在 game_init 之后开始，每个操作执行前记下，对局结束时收尾
+void replay_begin_record(Replay *r, const GameContext *g);
+void replay_record_input(Replay *r, const GameContext *g, GameInput in);
+void replay_finish(Replay *r, const GameContext *g);
+void replay_free(Replay *r);
+
+int replay_save(const Replay *r, const char *path);
+int replay_load(Replay *r, const char *path);
+
+// 重放：replay_start 初始化对局（地图不在地图包里时返回 0），replay_advance 执行到期的操作并推进一步
+// 录像结束后 replay_advance 返回 0
+int replay_start(ReplayCursor *c, const Replay *r, GameContext *g);
+int replay_advance(ReplayCursor *c, GameContext *g);
+
+// 一口气重放到底，结果与录制时一致返回 1
+int replay_run(const Replay *r, GameContext *g);
+
+#endif
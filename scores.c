@@ -0,0 +1,224 @@
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "scores.h"
+
+#define RUN_MAGIC 0x4e524c50u     // "PLRN"
+#define INDEX_MAGIC 0x58444c50u   // "PLDX"
+#define INDEX_VERSION 1
+
+struct ScoreIndex {
+    uint32_t magic, version;
+    uint32_t dirty;               // 正在从日志追赶；打开时还是 1 说明上次更新到一半崩溃了
+    uint32_t reserved;
+    uint64_t indexed;             // 日志的前这么多字节已经算进来了
+    ScoreBoard boards[SCORES_MAPS];
+};
+
+// FNV-1a
+static uint32_t fnv32(const void *p, size_t n) {
+    const unsigned char *b = p;
+    uint32_t h = 0x811c9dc5u;
+    for (size_t i = 0; i < n; i++) {
+        h = (h ^ b[i]) * 0x01000193u;
+    }
+    return h;
+}
+
+static uint32_t record_check(const RunRecord *r) {
+    size_t skip = offsetof(RunRecord, map_id);
+    return fnv32((const char *)r + skip, sizeof(*r) - skip);
+}
+
+// 地图标识在散列表里的位置，线性探测；create 时没有就占一个空位，表满了返回 NULL
+static ScoreBoard *find_board(struct ScoreIndex *x, const char *id, int create) {
+    uint32_t h = fnv32(id, strnlen(id, sizeof(x->boards[0].map_id)));
+    for (int k = 0; k < SCORES_MAPS; k++) {
+        ScoreBoard *b = &x->boards[(h + k) & (SCORES_MAPS - 1)];
+        if (b->map_id[0] == 0) {
+            if (!create) return NULL;
+            strncpy(b->map_id, id, sizeof(b->map_id));
+            return b;
+        }
+        if (strncmp(b->map_id, id, sizeof(b->map_id)) == 0) return b;
+    }
+    return NULL;
+}
+
+static void board_insert(ScoreBoard *b, const RunRecord *r, uint64_t offset) {
+    __atomic_add_fetch(&b->seq, 1, __ATOMIC_RELEASE);
+    b->runs++;
+    b->wins += r->won;
+    
+    // 同分的排在已有的后面
+    int pos = b->count;
+    while (pos > 0 && r->score > b->top[pos - 1].score) {
+        pos--;
+    }
+    if (pos < SCORES_TOP) {
+        int last = b->count < SCORES_TOP ? b->count : SCORES_TOP - 1;
+        memmove(&b->top[pos + 1], &b->top[pos], (last - pos) * sizeof(ScoreEntry));
+        ScoreEntry *e = &b->top[pos];
+        memset(e, 0, sizeof(*e));
+        e->score = r->score;
+        e->total_time = r->total_time;
+        e->when = r->when;
+        e->seed = r->seed;
+        e->offset = offset;
+        e->won = r->won;
+        if (b->count < SCORES_TOP) {
+            b->count++;
+        }
+    }
+    __atomic_add_fetch(&b->seq, 1, __ATOMIC_RELEASE);
+}
+
+// 把日志里还没算进索引的记录读进来，调用者拿着索引的文件锁
+// 索引是空的、版本不对或者上次更新到一半，先清空再从头读
+static void catch_up(ScoreStore *s) {
+    struct ScoreIndex *x = s->idx;
+    struct stat st;
+    if (fstat(s->log_fd, &st) < 0) return;
+    
+    if (x->magic != INDEX_MAGIC || x->version != INDEX_VERSION || x->dirty) {
+        memset(x, 0, sizeof(*x));
+        x->magic = INDEX_MAGIC;
+        x->version = INDEX_VERSION;
+    }
+    if (x->indexed + sizeof(RunRecord) > (uint64_t)st.st_size) return;
+    x->dirty = 1;
+    
+    // 校验不对的地方是写到一半的残缺记录，一个字节一个字节往后找下一条完整的
+    unsigned char buf[65536];
+    uint64_t pos = x->indexed;
+    while (pos + sizeof(RunRecord) <= (uint64_t)st.st_size) {
+        size_t want = (uint64_t)st.st_size - pos < sizeof(buf) ? (size_t)((uint64_t)st.st_size - pos) : sizeof(buf);
+        ssize_t n = pread(s->log_fd, buf, want, (off_t)pos);
+        if (n < (ssize_t)sizeof(RunRecord)) break;
+        
+        size_t i = 0;
+        while (i + sizeof(RunRecord) <= (size_t)n) {
+            RunRecord r;
+            memcpy(&r, buf + i, sizeof(r));
+            if (r.magic != RUN_MAGIC || r.check != record_check(&r)) {
+                i++;
+                continue;
+            }
+            ScoreBoard *b = find_board(x, r.map_id, 1);
+            if (b) {
+                board_insert(b, &r, pos + i);
+            }
+            i += sizeof(r);
+        }
+        pos += i;
+    }
+    
+    __atomic_store_n(&x->indexed, pos, __ATOMIC_RELEASE);
+    x->dirty = 0;
+}
+
+ScoreStore *scores_open(const char *log_path, const char **err) {
+    ScoreStore *s = calloc(1, sizeof(ScoreStore));
+    size_t len = strlen(log_path);
+    char *idx_path = malloc(len + 5);
+    memcpy(idx_path, log_path, len);
+    memcpy(idx_path + len, ".idx", 5);
+    
+    s->log_fd = open(log_path, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+    s->idx_fd = open(idx_path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    free(idx_path);
+    if (s->log_fd < 0 || s->idx_fd < 0) {
+        *err = "无法打开战绩文件";
+        goto fail;
+    }
+    
+    flock(s->idx_fd, LOCK_EX);
+    struct stat st;
+    if (fstat(s->idx_fd, &st) < 0 || (st.st_size < (off_t)sizeof(struct ScoreIndex) &&
+                                       ftruncate(s->idx_fd, sizeof(struct ScoreIndex)) < 0)) {
+        flock(s->idx_fd, LOCK_UN);
+        *err = "无法扩展战绩索引";
+        goto fail;
+    }
+    s->idx = mmap(NULL, sizeof(struct ScoreIndex), PROT_READ | PROT_WRITE, MAP_SHARED, s->idx_fd, 0);
+    if (s->idx == MAP_FAILED) {
+        s->idx = NULL;
+        flock(s->idx_fd, LOCK_UN);
+        *err = "无法映射战绩索引";
+        goto fail;
+    }
+    catch_up(s);
+    flock(s->idx_fd, LOCK_UN);
+    
+    pthread_mutex_init(&s->lock, NULL);
+    return s;
+
+fail:
+    if (s->log_fd >= 0) close(s->log_fd);
+    if (s->idx_fd >= 0) close(s->idx_fd);
+    free(s);
+    return NULL;
+}
+
+void scores_close(ScoreStore *s) {
+    if (!s) return;
+    munmap(s->idx, sizeof(struct ScoreIndex));
+    close(s->log_fd);
+    close(s->idx_fd);
+    pthread_mutex_destroy(&s->lock);
+    free(s);
+}
+
+int scores_append(ScoreStore *s, RunRecord *r) {
+    r->magic = RUN_MAGIC;
+    r->check = record_check(r);
+    
+    // O_APPEND 的一次 write 不会和别的线程、进程交错，不用加锁；索引留给 scores_sync 去追
+    if (write(s->log_fd, r, sizeof(*r)) != (ssize_t)sizeof(*r)) return -1;
+    fdatasync(s->log_fd);
+    return 0;
+}
+
+int scores_rank(ScoreStore *s, const char *map_id, int32_t score) {
+    ScoreBoard b;
+    if (!scores_board(s, map_id, &b)) return 1;
+    
+    // 同分的排在已有的后面
+    int rank = 1;
+    for (uint32_t i = 0; i < b.count && b.top[i].score >= score; i++) {
+        rank++;
+    }
+    return rank <= SCORES_TOP ? rank : 0;
+}
+
+void scores_sync(ScoreStore *s) {
+    struct stat st;
+    if (fstat(s->log_fd, &st) < 0) return;
+    if (__atomic_load_n(&s->idx->indexed, __ATOMIC_ACQUIRE) + sizeof(RunRecord) > (uint64_t)st.st_size) return;
+    
+    pthread_mutex_lock(&s->lock);
+    flock(s->idx_fd, LOCK_EX);
+    catch_up(s);
+    flock(s->idx_fd, LOCK_UN);
+    pthread_mutex_unlock(&s->lock);
+}
+
+int scores_board(ScoreStore *s, const char *map_id, ScoreBoard *out) {
+    ScoreBoard *b = find_board(s->idx, map_id, 0);
+    if (!b) return 0;
+    
+    // 序号是奇数或者拷贝前后变了，说明别的进程正在改，重读
+    uint32_t seq;
+    do {
+        seq = __atomic_load_n(&b->seq, __ATOMIC_ACQUIRE);
+        memcpy(out, b, sizeof(*out));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((seq & 1) || seq != __atomic_load_n(&b->seq, __ATOMIC_RELAXED));
+    return out->runs > 0;
+}
@@ -0,0 +1,78 @@
+#ifndef SCORES_H
+#define SCORES_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+// 战绩：每局结束时往日志里追加一条记录，另有一个按地图分的排行榜索引
+//
+// 日志 (scores.log) 只追加不修改，每条记录定长，带校验和。几个游戏进程可以同时追加：
+// O_APPEND 的一次 write 不会和别人交错，不用加锁；写完 fdatasync，断电也不丢已经结束的局。
+// 写到一半崩溃留下的残缺记录读的时候按校验和跳过
+//
+// 索引 (scores.log.idx) 整个 mmap 进来，每张地图一块：前 SCORES_TOP 名和总局数、胜局数。
+// 索引只是日志的缓存，记着日志的前多少字节已经算进去了。追加时不碰索引，
+// 要看排行榜之前 (scores_sync) 再从那里接着读新记录，这时才拿文件锁 (flock)，只锁索引不锁日志。
+// 读排行榜不加锁（每块有个序号，读到一半被改了就重读），
+// 不管日志里有多少局，读一张地图的排行榜都只是拷贝一块固定大小的内存。
+// 更新到一半崩溃的话索引头上留着标记，下次打开时从日志整个重建
+
+#define SCORES_TOP 10       // 每张地图留前几名
+#define SCORES_MAPS 1024    // 索引里最多几张地图，散列表的大小，2 的幂
+
+// 日志里的一条记录
+typedef struct {
+    uint32_t magic;
+    uint32_t check;         // 后面所有字节的校验和
+    char map_id[16];
+    int64_t when;           // 结束时间（Unix 秒）
+    uint64_t seed;
+    int32_t score;
+    int32_t total_time;     // 秒
+    int32_t game_time;      // 模拟步数
+    uint8_t won;
+    uint8_t pad[3];
+} RunRecord;
+
+typedef struct {
+    int32_t score, total_time;
+    int64_t when;
+    uint64_t seed;
+    uint64_t offset;        // 记录在日志里的位置，同一局不会上榜两次
+    uint8_t won;
+    uint8_t pad[7];
+} ScoreEntry;
+
+// 一张地图的排行榜
+typedef struct {
+    uint32_t seq;           // 更新时先加一成奇数，改完再加一
+    uint32_t count;         // 榜上有几条
+    char map_id[16];
+    uint64_t runs, wins;
+    ScoreEntry top[SCORES_TOP];   // 分数从高到低，同分的先打出来的在前
+} ScoreBoard;
+
+typedef struct {
+    int log_fd, idx_fd;
+    struct ScoreIndex *idx;
+    pthread_mutex_t lock;   // 本进程里同时只有一个线程更新索引（flock 对同一个进程的几个线程不互斥）
+} ScoreStore;
+
+// 打开（没有就创建）日志和索引，索引文件名是日志文件名加 .idx；失败时返回 NULL，*err 是原因
+ScoreStore *scores_open(const char *log_path, const char **err);
+void scores_close(ScoreStore *s);
+
+// 追加一局（magic 和 check 不用填）：只有一次 write 和 fdatasync，不拿锁也不碰索引；写失败返回 -1
+int scores_append(ScoreStore *s, RunRecord *r);
+
+// 这个分数在这张地图现在的排行榜上排第几（从 1 开始），上不了榜返回 0；不加锁，只读索引
+// 索引里还没算进去的局不计，所以追加之前先问名次
+int scores_rank(ScoreStore *s, const char *map_id, int32_t score);
+
+// 把新追加的记录（包括本进程的）算进索引，拿索引的文件锁；日志没变长时只有一次 fstat
+void scores_sync(ScoreStore *s);
+
+// 读一张地图的排行榜，没有这张地图的记录时返回 0
+int scores_board(ScoreStore *s, const char *map_id, ScoreBoard *out);
+
+#endif
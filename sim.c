@@ -0,0 +1,648 @@
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bot.h"
+#include "game.h"
+#include "mapfile.h"
+#include "replay.h"
+#include "snapshot.h"
+
+// 蒙特卡洛平衡测试：不依赖终端，在所有地图和玩家策略上批量跑完整局
+// 每个工作线程有自己的任务队列，空了就去别的线程队列里偷任务
+// 每局的随机种子只由 (总种子, 地图, 局号) 决定，结果与线程数和调度无关，
+// 同一地图上不同策略用的是同一批种子，策略之间的差别更容易看出来
+//
+// 用法: sim [-n 每组局数] [-t 线程数] [-m 地图编号] [-p 策略] [-s 种子]
+//           [-r 参数=值]... [--maps 地图包] [--csv | --json]
+//       sim --record 文件 [-m 地图] [-p 策略] [-s 种子]   录下一局
+//       sim --replay 文件... [-n 次数]                    核对录像结果并计时
+//       sim --branch 文件 --at 步数 [-n 局数] [-p 策略]    从录像的某一步分出很多局，看这个局面的胜率
+//       sim -p bot [-n 局数]                              前瞻搜索的自动玩家 (bot.h)，每张地图接近最优玩法的基准
+
+// 玩家策略
+typedef enum {
+    POLICY_BED,     // 一直在床上玩，从不躲
+    POLICY_HIDE,    // 看到警告或父母就去隐藏区域，安全后回床上
+    POLICY_LATE,    // 只在父母走近时才去躲
+    POLICY_RANDOM,  // 随机乱走
+    POLICY_BOT,     // 前瞻搜索 (bot.h)，每步要算一两毫秒，只在 -p bot 时跑
+    POLICY_COUNT
+} Policy;
+
+static const char *policy_names[POLICY_COUNT] = { "bed", "hide", "late", "random", "bot" };
+
+#define HIST_BUCKETS 10    // 被抓时间直方图，每格10秒
+#define CHUNK_GAMES 1000   // 每个任务包含的局数
+#define BOT_CHUNK_GAMES 4  // 自动玩家一局要一两秒，任务切小一点才分得匀
+
+// 一组实验：一张地图上的一种策略
+typedef struct {
+    MapType map;
+    Policy policy;
+    long games;
+    long wins;
+    long caught[HIST_BUCKETS];
+    long long score_sum;
+    long long ticks;
+} Combo;
+
+// 一个任务：某组实验中连续的一段局，结果只由执行它的线程写
+typedef struct {
+    int combo;
+    long first;
+    int count;
+    long wins;
+    long caught[HIST_BUCKETS];
+    long long score_sum;
+    long long ticks;
+    
+    // 自动玩家的统计
+    long decisions;
+    long long think_ns, nodes, tt_hits;
+    uint64_t think_max_ns;
+} Job;
+
+// 双端任务队列：自己从尾部取，别人从头部偷
+typedef struct {
+    pthread_mutex_t lock;
+    int *items;
+    int head, tail;
+} __attribute__((aligned(64))) WorkQueue;
+
+static Combo *combos;
+static Job *jobs;
+static WorkQueue *queues;
+static int thread_count;
+static uint64_t base_seed = 20240101;
+static GameRules rules;
+static unsigned char *branch_snap;  // 分支模式的起始局面，其他模式为 NULL
+
+static uint64_t mix64(uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+// 离玩家最近的家人的曼哈顿距离，房间里没人时返回很大的数
+static int nearest_parent(const GameContext *g) {
+    const NpcStore *n = &g->npcs;
+    int best = 1 << 20;
+    for (int i = 0; i < n->count; i++) {
+        int d = abs(n->x[i] - g->player.x) + abs(n->y[i] - g->player.y);
+        if (d < best) {
+            best = d;
+        }
+    }
+    return best;
+}
+
+// 策略自己的随机数和游戏的分开，不会打乱游戏的随机序列
+static GameInput choose_input(const GameContext *g, Policy policy, GameRng *own, Bot *bot) {
+    const GameMap *map = g->map;
+    int danger;
+    
+    switch (policy) {
+        case POLICY_BED:
+            return INPUT_NONE;
+        case POLICY_RANDOM:
+            return (GameInput)rng_range(own, 5);
+        case POLICY_BOT:
+            return bot_choose(bot, g);
+        case POLICY_HIDE:
+            danger = g->warning_timer > 0 || nearest_parent(g) < (1 << 20);
+            break;
+        case POLICY_LATE:
+        default:
+            danger = nearest_parent(g) <= g->rules.catch_distance + 3;
+            break;
+    }
+    
+    // 沿地图的距离场走，到了就停下
+    return nav_step(map, danger ? NAV_HIDE : NAV_BED, g->player.x, g->player.y);
+}
+
+// 第 n 局的种子
+static uint64_t game_seed(MapType map, uint64_t n) {
+    return mix64(base_seed ^ mix64(((uint64_t)map << 56) ^ n));
+}
+
+static void run_job(Job *job) {
+    Combo *c = &combos[job->combo];
+    GameContext g;
+    GameRng own;
+    Bot *bot = NULL;
+    
+    // 不限时间，每步的搜索量固定，结果与机器快慢无关
+    if (c->policy == POLICY_BOT) {
+        bot = bot_new();
+        bot->budget_ns = 0;
+    }
+    g.map = NULL;
+    for (int k = 0; k < job->count; k++) {
+        uint64_t seed = game_seed(c->map, job->first + k);
+        if (branch_snap) {
+            // 从同一个局面往后，每局只换游戏的随机种子
+            snapshot_restore(&g, branch_snap);
+            rng_seed(&g.rng, seed);
+        } else {
+            game_init(&g, c->map, &rules, seed);
+        }
+        rng_seed(&own, seed ^ 0x5bd1e995ULL);
+        
+        while (g.state == PLAYING) {
+            game_step(&g, choose_input(&g, c->policy, &own, bot));
+            job->ticks++;
+        }
+        
+        if (g.state == WIN) {
+            job->wins++;
+        } else {
+            int b = g.total_time * HIST_BUCKETS / g.rules.win_time;
+            job->caught[b < HIST_BUCKETS ? b : HIST_BUCKETS - 1]++;
+        }
+        job->score_sum += g.player.score;
+    }
+    
+    if (bot) {
+        job->decisions = bot->decisions;
+        job->think_ns = (long long)bot->think_ns;
+        job->think_max_ns = bot->think_max_ns;
+        job->nodes = bot->nodes;
+        job->tt_hits = bot->tt_hits;
+        bot_free(bot);
+    }
+}
+
+static int queue_pop(WorkQueue *q) {
+    int job = -1;
+    pthread_mutex_lock(&q->lock);
+    if (q->tail > q->head) {
+        job = q->items[--q->tail];
+    }
+    pthread_mutex_unlock(&q->lock);
+    return job;
+}
+
+static int queue_steal(WorkQueue *q) {
+    int job = -1;
+    pthread_mutex_lock(&q->lock);
+    if (q->tail > q->head) {
+        job = q->items[q->head++];
+    }
+    pthread_mutex_unlock(&q->lock);
+    return job;
+}
+
+// 所有任务一开始就已经入队，各队列都空了就说明做完了
+static void *worker(void *arg) {
+    int self = (int)(long)arg;
+    
+    for (;;) {
+        int job = queue_pop(&queues[self]);
+        for (int v = 1; job < 0 && v < thread_count; v++) {
+            job = queue_steal(&queues[(self + v) % thread_count]);
+        }
+        if (job < 0) {
+            break;
+        }
+        run_job(&jobs[job]);
+    }
+    return NULL;
+}
+
+// Wilson 95% 置信区间
+static void wilson(long k, long n, double *lo, double *hi) {
+    const double z = 1.96;
+    if (n == 0) {
+        *lo = 0;
+        *hi = 1;
+        return;
+    }
+    double p = (double)k / n;
+    double d = 1 + z * z / n;
+    double center = (p + z * z / (2.0 * n)) / d;
+    double half = z * sqrt(p * (1 - p) / n + z * z / (4.0 * n * n)) / d;
+    *lo = center - half;
+    *hi = center + half;
+}
+
+static int set_rule(const char *spec) {
+    char name[32];
+    int value;
+    if (sscanf(spec, "%31[^=]=%d", name, &value) != 2) return 0;
+    
+    if (strcmp(name, "check_interval") == 0) {
+        rules.check_interval = value;
+    } else if (strcmp(name, "spawn_chance") == 0) {
+        rules.spawn_chance = value;
+    } else if (strcmp(name, "parent_time") == 0) {
+        rules.parent_time = value;
+    } else if (strcmp(name, "catch_distance") == 0) {
+        rules.catch_distance = value;
+    } else if (strcmp(name, "win_time") == 0) {
+        rules.win_time = value;
+    } else if (strcmp(name, "max_npcs") == 0) {
+        rules.max_npcs = value;
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+static void print_text(int ncombo) {
+    // 中文每个字占3字节、显示2格，宽度按字节补齐
+    printf("%-16s %-9s %11s %10s %22s %13s  被抓时间分布(每格%d秒)\n",
+           "地图", "策略", "局数", "胜率", "95%置信区间", "平均得分",
+           rules.win_time / HIST_BUCKETS);
+    for (int i = 0; i < ncombo; i++) {
+        Combo *c = &combos[i];
+        double lo, hi;
+        wilson(c->wins, c->games, &lo, &hi);
+        printf("%-14s %-7s %9ld %7.2f%% [%6.2f%%, %6.2f%%] %9.1f ",
+               map_get(c->map)->map_id, policy_names[c->policy], c->games,
+               100.0 * c->wins / c->games, 100 * lo, 100 * hi,
+               (double)c->score_sum / c->games);
+        for (int b = 0; b < HIST_BUCKETS; b++) {
+            printf(" %ld", c->caught[b]);
+        }
+        printf("\n");
+    }
+}
+
+static void print_csv(int ncombo) {
+    printf("map,policy,games,wins,win_rate,ci_low,ci_high,avg_score,avg_ticks");
+    for (int b = 0; b < HIST_BUCKETS; b++) {
+        printf(",caught_%d", b);
+    }
+    printf("\n");
+    for (int i = 0; i < ncombo; i++) {
+        Combo *c = &combos[i];
+        double lo, hi;
+        wilson(c->wins, c->games, &lo, &hi);
+        printf("%s,%s,%ld,%ld,%.6f,%.6f,%.6f,%.3f,%.3f", map_get(c->map)->map_id,
+               policy_names[c->policy], c->games, c->wins, (double)c->wins / c->games,
+               lo, hi, (double)c->score_sum / c->games, (double)c->ticks / c->games);
+        for (int b = 0; b < HIST_BUCKETS; b++) {
+            printf(",%ld", c->caught[b]);
+        }
+        printf("\n");
+    }
+}
+
+static void print_json(int ncombo) {
+    printf("{\"seed\":%llu,\"rules\":{\"check_interval\":%d,\"spawn_chance\":%d,"
+           "\"parent_time\":%d,\"catch_distance\":%d,\"win_time\":%d,\"max_npcs\":%d},"
+           "\"results\":[\n",
+           (unsigned long long)base_seed, rules.check_interval, rules.spawn_chance,
+           rules.parent_time, rules.catch_distance, rules.win_time, rules.max_npcs);
+    for (int i = 0; i < ncombo; i++) {
+        Combo *c = &combos[i];
+        double lo, hi;
+        wilson(c->wins, c->games, &lo, &hi);
+        printf("  {\"map\":\"%s\",\"policy\":\"%s\",\"games\":%ld,\"wins\":%ld,"
+               "\"win_rate\":%.6f,\"ci95\":[%.6f,%.6f],\"avg_score\":%.3f,"
+               "\"avg_ticks\":%.3f,\"caught_hist\":[",
+               map_get(c->map)->map_id, policy_names[c->policy], c->games, c->wins,
+               (double)c->wins / c->games, lo, hi, (double)c->score_sum / c->games,
+               (double)c->ticks / c->games);
+        for (int b = 0; b < HIST_BUCKETS; b++) {
+            printf("%s%ld", b ? "," : "", c->caught[b]);
+        }
+        printf("]}%s\n", i + 1 < ncombo ? "," : "");
+    }
+    printf("]}\n");
+}
+
+// 用指定策略玩一局并存成录像
+static int record_game(const char *path, MapType map, Policy policy) {
+    GameContext g;
+    GameRng own;
+    Replay r;
+    uint64_t seed = game_seed(map, 0);
+    
+    if (!game_init(&g, map, &rules, seed)) {
+        fprintf(stderr, "地图 %d 不可用\n", map);
+        return 0;
+    }
+    rng_seed(&own, seed ^ 0x5bd1e995ULL);
+    Bot *bot = policy == POLICY_BOT ? bot_new() : NULL;
+    replay_begin_record(&r, &g);
+    while (g.state == PLAYING) {
+        GameInput in = choose_input(&g, policy, &own, bot);
+        replay_record_input(&r, &g, in);
+        game_step(&g, in);
+    }
+    replay_finish(&r, &g);
+    bot_free(bot);
+    
+    int ok = replay_save(&r, path);
+    if (ok) {
+        printf("%s: %s %s %s 得分 %d, %d 步, 事件流 %zu 字节\n", path, g.map->map_id,
+               policy_names[policy], g.state == WIN ? "胜利" : "被抓", g.player.score,
+               g.game_time, r.len);
+    } else {
+        fprintf(stderr, "无法写入录像: %s\n", path);
+    }
+    replay_free(&r);
+    return ok;
+}
+
+// 重放每个录像 repeat 次，核对结果并统计速度；结果不一致返回 0
+static int run_replays(char **paths, int count, long repeat) {
+    int all_ok = 1;
+    
+    for (int i = 0; i < count; i++) {
+        Replay r;
+        if (!replay_load(&r, paths[i])) {
+            fprintf(stderr, "无法读取录像: %s\n", paths[i]);
+            all_ok = 0;
+            continue;
+        }
+        if (!map_get(r.map)) {
+            fprintf(stderr, "%s: 录像用到的地图不在地图包里\n", paths[i]);
+            replay_free(&r);
+            all_ok = 0;
+            continue;
+        }
+        
+        GameContext g;
+        int ok = 1;
+        struct timespec t0, t1;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        for (long k = 0; k < repeat; k++) {
+            ok &= replay_run(&r, &g);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        double secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+        if (secs <= 0) {
+            secs = 1e-9;
+        }
+        
+        printf("%s: %s 得分 %d/%d 步数 %d/%d %.0f 步/秒 (%.0f 倍实时)\n", paths[i],
+               ok ? "一致" : "不一致", g.player.score, r.result_score, g.game_time,
+               r.result_ticks, (double)r.result_ticks * repeat / secs,
+               (double)r.result_ticks * repeat / secs / 10);
+        all_ok &= ok;
+        replay_free(&r);
+    }
+    return all_ok;
+}
+
+// 把录像重放到第 at 步存成快照，之后每局都从快照恢复，不用每局从头重放
+// 返回录像的地图编号，出错返回 -1
+static int branch_from(const char *path, int at) {
+    Replay r;
+    if (!replay_load(&r, path)) {
+        fprintf(stderr, "无法读取录像: %s\n", path);
+        return -1;
+    }
+    
+    GameContext g;
+    ReplayCursor cur;
+    if (!replay_start(&cur, &r, &g)) {
+        fprintf(stderr, "%s: 录像用到的地图不在地图包里\n", path);
+        replay_free(&r);
+        return -1;
+    }
+    while (g.state == PLAYING && g.game_time < at && replay_advance(&cur, &g)) {
+    }
+    replay_free(&r);
+    if (g.state != PLAYING || g.game_time < at) {
+        fprintf(stderr, "%s: 第 %d 步之前对局已经结束（共 %d 步）\n", path, at, g.game_time);
+        return -1;
+    }
+    
+    branch_snap = malloc(SNAPSHOT_MAX_SIZE);
+    size_t size = snapshot_save(&g, branch_snap);
+    rules = g.rules;
+    fprintf(stderr, "%s: 从第 %d 步分支（已坚持 %d 秒，玩家在 (%d, %d)，房间里 %d 人，快照 %zu 字节）\n",
+            path, at, g.total_time, g.player.x, g.player.y, g.npcs.count, size);
+    return g.map_type;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "用法: %s [-n 每组局数] [-t 线程数] [-m 地图编号] [-p bed|hide|late|random|bot]\n"
+            "          [-s 种子] [-r 参数=值]... [--maps 地图包] [--csv | --json]\n"
+            "       %s --record 文件 [-m 地图] [-p 策略] [-s 种子]\n"
+            "       %s --replay 文件... [-n 次数]\n"
+            "       %s --branch 文件 --at 步数 [-n 局数] [-p 策略] [-s 种子]\n"
+            "参数: check_interval spawn_chance parent_time catch_distance win_time max_npcs\n",
+            prog, prog, prog, prog);
+}
+
+int main(int argc, char *argv[]) {
+    long games = 100000;
+    int only_map = -1;
+    int only_policy = -1;
+    int format = 0;  // 0:表格 1:CSV 2:JSON
+    int games_given = 0;
+    const char *record_path = NULL;
+    char **replay_paths = calloc(argc, sizeof(char *));
+    int replay_count = 0;
+    const char *maps_path = NULL;   // 默认用内置地图
+    const char *branch_path = NULL;
+    int branch_at = 0;
+    
+    rules = default_rules;
+    thread_count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            games = atol(argv[++i]);
+            games_given = 1;
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            thread_count = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            only_map = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            i++;
+            for (int p = 0; p < POLICY_COUNT; p++) {
+                if (strcmp(argv[i], policy_names[p]) == 0) {
+                    only_policy = p;
+                }
+            }
+            if (only_policy < 0) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            base_seed = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            if (!set_rule(argv[++i])) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            record_path = argv[++i];
+        } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            while (i + 1 < argc && argv[i + 1][0] != '-') {
+                replay_paths[replay_count++] = argv[++i];
+            }
+        } else if (strcmp(argv[i], "--branch") == 0 && i + 1 < argc) {
+            branch_path = argv[++i];
+        } else if (strcmp(argv[i], "--at") == 0 && i + 1 < argc) {
+            branch_at = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--maps") == 0 && i + 1 < argc) {
+            maps_path = argv[++i];
+        } else if (strcmp(argv[i], "--csv") == 0) {
+            format = 1;
+        } else if (strcmp(argv[i], "--json") == 0) {
+            format = 2;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (only_policy == POLICY_BOT && !games_given) {
+        games = 200;
+    }
+    if (games < 1 || rules.win_time < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (thread_count < 1) {
+        thread_count = 1;
+    }
+    
+    const char *err;
+    if (!maps_path) {
+        maps_use_builtin(builtin_maps, builtin_map_count);
+    } else if (!maps_load(maps_path, &err)) {
+        fprintf(stderr, "%s: %s\n", maps_path, err);
+        return 1;
+    }
+    if (only_map >= map_count) {
+        usage(argv[0]);
+        return 1;
+    }
+    
+    if (record_path || replay_count > 0) {
+        int ok = 1;
+        if (record_path) {
+            ok = record_game(record_path, only_map >= 0 ? (MapType)only_map : EUROPE_US,
+                             only_policy >= 0 ? (Policy)only_policy : POLICY_HIDE);
+        }
+        if (replay_count > 0) {
+            ok &= run_replays(replay_paths, replay_count, games_given ? games : 1000);
+        }
+        free(replay_paths);
+        maps_unload();
+        return ok ? 0 : 1;
+    }
+    
+    // 分支模式只跑录像那张地图，规则也用录像里的
+    if (branch_path) {
+        only_map = branch_from(branch_path, branch_at);
+        if (only_map < 0) {
+            free(replay_paths);
+            maps_unload();
+            return 1;
+        }
+    }
+    
+    // 生成实验组；地图在这里第一次打开，工作线程里只读
+    combos = calloc(map_count * POLICY_COUNT, sizeof(Combo));
+    int ncombo = 0;
+    for (int m = 0; m < map_count; m++) {
+        if (only_map >= 0 && m != only_map) continue;
+        if (!map_get(m)) {
+            fprintf(stderr, "跳过损坏的地图 %d\n", m);
+            continue;
+        }
+        for (int p = 0; p < POLICY_COUNT; p++) {
+            if (only_policy >= 0 ? p != only_policy : p == POLICY_BOT) continue;
+            combos[ncombo].map = (MapType)m;
+            combos[ncombo].policy = (Policy)p;
+            combos[ncombo].games = games;
+            ncombo++;
+        }
+    }
+    
+    // 切分任务，轮流分给各线程的队列
+    int chunk_games = only_policy == POLICY_BOT ? BOT_CHUNK_GAMES : CHUNK_GAMES;
+    long chunks = (games + chunk_games - 1) / chunk_games;
+    int njobs = (int)(chunks * ncombo);
+    jobs = calloc(njobs, sizeof(Job));
+    queues = calloc(thread_count, sizeof(WorkQueue));
+    for (int t = 0; t < thread_count; t++) {
+        pthread_mutex_init(&queues[t].lock, NULL);
+        queues[t].items = malloc(njobs * sizeof(int));
+    }
+    for (int j = 0; j < njobs; j++) {
+        jobs[j].combo = j / chunks;
+        jobs[j].first = (j % chunks) * chunk_games;
+        jobs[j].count = (int)(games - jobs[j].first < chunk_games ? games - jobs[j].first
+                                                                  : chunk_games);
+        WorkQueue *q = &queues[j % thread_count];
+        q->items[q->tail++] = j;
+    }
+    
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    
+    pthread_t *threads = malloc(thread_count * sizeof(pthread_t));
+    for (int t = 0; t < thread_count; t++) {
+        pthread_create(&threads[t], NULL, worker, (void *)(long)t);
+    }
+    for (int t = 0; t < thread_count; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    
+    // 汇总
+    long long total_ticks = 0;
+    Job bot = { 0 };
+    for (int j = 0; j < njobs; j++) {
+        Combo *c = &combos[jobs[j].combo];
+        c->wins += jobs[j].wins;
+        c->score_sum += jobs[j].score_sum;
+        c->ticks += jobs[j].ticks;
+        for (int b = 0; b < HIST_BUCKETS; b++) {
+            c->caught[b] += jobs[j].caught[b];
+        }
+        total_ticks += jobs[j].ticks;
+        bot.decisions += jobs[j].decisions;
+        bot.think_ns += jobs[j].think_ns;
+        bot.nodes += jobs[j].nodes;
+        bot.tt_hits += jobs[j].tt_hits;
+        if (jobs[j].think_max_ns > bot.think_max_ns) {
+            bot.think_max_ns = jobs[j].think_max_ns;
+        }
+    }
+    
+    if (format == 1) {
+        print_csv(ncombo);
+    } else if (format == 2) {
+        print_json(ncombo);
+    } else {
+        print_text(ncombo);
+    }
+    fprintf(stderr, "%d 线程, %.3f秒, %.0f 局/秒, %.0f 步/秒\n", thread_count, secs,
+            games * ncombo / secs, total_ticks / secs);
+    if (bot.decisions > 0) {
+        fprintf(stderr, "自动玩家: 每步决策平均 %.0f 微秒，最慢 %.2f 毫秒，搜索 %lld 个局面，置换表命中 %.1f%%\n",
+                bot.think_ns / 1e3 / bot.decisions, bot.think_max_ns / 1e6, bot.nodes,
+                bot.nodes ? 100.0 * bot.tt_hits / bot.nodes : 0.0);
+    }
+    
+    for (int t = 0; t < thread_count; t++) {
+        pthread_mutex_destroy(&queues[t].lock);
+        free(queues[t].items);
+    }
+    free(threads);
+    free(queues);
+    free(jobs);
+    free(combos);
+    free(replay_paths);
+    free(branch_snap);
+    maps_unload();
+    return 0;
+}
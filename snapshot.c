@@ -0,0 +1,141 @@
+#include <string.h>
+
+#include "house.h"
+#include "snapshot.h"
+
+// 按顺序写 / 读一列
+#define PUT(p, col, n) (memcpy(p, col, (n) * sizeof(*(col))), (p) += (n) * sizeof(*(col)))
+#define GET(p, col, n) (memcpy(col, p, (n) * sizeof(*(col))), (p) += (n) * sizeof(*(col)))
+
+size_t snapshot_save(const GameContext *g, void *buf) {
+    const NpcStore *n = &g->npcs;
+    SnapshotHeader h;
+    memset(&h, 0, sizeof(h));
+    h.state = g->state;
+    h.map_type = g->map_type;
+    h.rules = g->rules;
+    h.seed = g->seed;
+    h.rng = g->rng;
+    h.player = g->player;
+    h.game_time = g->game_time;
+    h.total_time = g->total_time;
+    h.parent_check_timer = g->parent_check_timer;
+    h.warning_timer = g->warning_timer;
+    if (g->map->house) {
+        h.house_cx = g->map->house->org_cx;
+        h.house_cy = g->map->house->org_cy;
+    }
+    h.npc_count = (uint16_t)n->count;
+    h.free_count = (uint16_t)n->free_count;
+    h.next_id = (uint16_t)n->next_id;
+    
+    unsigned char *p = (unsigned char *)buf + sizeof(h);
+    PUT(p, n->timer, n->count);
+    PUT(p, n->x, n->count);
+    PUT(p, n->y, n->count);
+    PUT(p, n->id, n->count);
+    PUT(p, n->free_ids, n->free_count);
+    PUT(p, n->target, n->count);
+    PUT(p, n->kind, n->count);
+    
+    h.size = (uint32_t)(p - (unsigned char *)buf);
+    memcpy(buf, &h, sizeof(h));
+    return h.size;
+}
+
+int snapshot_restore(GameContext *g, const void *buf) {
+    SnapshotHeader h;
+    memcpy(&h, buf, sizeof(h));
+    
+    // 整栋房子不在地图包里，只能恢复到同一栋房子
+    const GameMap *map = g->map;
+    if (!map || map->type != (MapType)h.map_type) {
+        if ((MapType)h.map_type == MAP_HOUSE || !(map = map_get(h.map_type))) return 0;
+    }
+    if (map->house) house_goto(map->house, h.house_cx, h.house_cy);
+    
+    g->state = (GameState)h.state;
+    g->map_type = (MapType)h.map_type;
+    g->map = map;
+    g->rules = h.rules;
+    g->seed = h.seed;
+    g->rng = h.rng;
+    g->player = h.player;
+    g->game_time = h.game_time;
+    g->total_time = h.total_time;
+    g->parent_check_timer = h.parent_check_timer;
+    g->warning_timer = h.warning_timer;
+    
+    NpcStore *n = &g->npcs;
+    n->count = h.npc_count;
+    n->free_count = h.free_count;
+    n->next_id = h.next_id;
+    const unsigned char *p = (const unsigned char *)buf + sizeof(h);
+    GET(p, n->timer, n->count);
+    GET(p, n->x, n->count);
+    GET(p, n->y, n->count);
+    GET(p, n->id, n->count);
+    GET(p, n->free_ids, n->free_count);
+    GET(p, n->target, n->count);
+    GET(p, n->kind, n->count);
+    npc_reindex(n);
+    return 1;
+}
+
+void snapshots_clear(SnapshotRing *r) {
+    r->first = 0;
+    r->count = 0;
+    r->tail = 0;
+}
+
+// 第 k 旧的一份在 slot 里的位置
+static inline int ring_slot(const SnapshotRing *r, int k) {
+    return (r->first + k) % SNAPSHOT_RING_SLOTS;
+}
+
+static int ring_overlaps(const SnapshotRing *r, uint32_t off, uint32_t size) {
+    for (int k = 0; k < r->count; k++) {
+        int s = ring_slot(r, k);
+        if (r->slot[s].off < off + size && off < r->slot[s].off + r->slot[s].size) return 1;
+    }
+    return 0;
+}
+
+void snapshots_push(SnapshotRing *r, const GameContext *g) {
+    // 一份快照不跨过缓冲区末尾，放不下就从头开始写
+    uint32_t size = (uint32_t)(sizeof(SnapshotHeader) + (size_t)g->npcs.count * 12 + (size_t)g->npcs.free_count * 2);
+    size = (size + 7) & ~7u;
+    if (r->tail + size > SNAPSHOT_RING_BYTES) r->tail = 0;
+    
+    // 从最旧的开始丢，直到不会被覆盖为止
+    while (r->count > 0 && (r->count == SNAPSHOT_RING_SLOTS || ring_overlaps(r, r->tail, size))) {
+        r->first = ring_slot(r, 1);
+        r->count--;
+    }
+    
+    int s = ring_slot(r, r->count);
+    r->slot[s].off = r->tail;
+    r->slot[s].size = size;
+    r->slot[s].tick = g->game_time;
+    snapshot_save(g, r->data + r->tail);
+    r->count++;
+    r->tail += size;
+}
+
+const void *snapshots_get(const SnapshotRing *r, int i, int *tick) {
+    if (i < 0 || i >= r->count) return NULL;
+    int s = ring_slot(r, r->count - 1 - i);
+    if (tick) *tick = r->slot[s].tick;
+    return r->data + r->slot[s].off;
+}
+
+void snapshots_truncate(SnapshotRing *r, int keep) {
+    if (keep >= r->count) return;
+    r->count = keep > 0 ? keep : 0;
+    if (r->count == 0) {
+        r->tail = 0;
+    } else {
+        int s = ring_slot(r, r->count - 1);
+        r->tail = r->slot[s].off + r->slot[s].size;
+    }
+}
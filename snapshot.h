@@ -0,0 +1,63 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "game.h"
+
+// 快照：某一步的完整对局状态，存成一段紧凑的字节，没有指针，可以直接复制或写进文件
+// 存 GameContext 里除地图指针以外的全部字段（玩家、计时器、随机数状态、游戏状态），
+// 家人只存活跃的前 count 个和空闲编号表，编号索引和空间网格恢复时重建；
+// 房间里通常只有几个人，一份快照二百多字节。整栋房子模式还记下窗口的位置，恢复时把窗口挪回去
+//
+// 从快照恢复后接着执行同样的操作，得到的对局和没有中断时完全相同
+
+typedef struct {
+    uint32_t size;              // 整个快照的字节数，包括这个头
+    int32_t state;              // GameState
+    int32_t map_type;
+    GameRules rules;
+    uint64_t seed;
+    GameRng rng;
+    Player player;
+    int32_t game_time, total_time, parent_check_timer, warning_timer;
+    int32_t house_cx, house_cy; // 整栋房子模式下窗口左上角的块坐标
+    uint16_t npc_count, free_count, next_id, reserved;
+} SnapshotHeader;
+
+// 头后面依次是 timer[count] (int32)，x[count]、y[count]、id[count]、free_ids[free_count] (16位)，
+// target[count]、kind[count] (8位)
+#define SNAPSHOT_MAX_SIZE (sizeof(SnapshotHeader) + MAX_NPCS * 12 + MAX_NPCS * 2)
+
+// 把 g 存进 buf（至少 SNAPSHOT_MAX_SIZE 字节），返回用了多少字节
+size_t snapshot_save(const GameContext *g, void *buf);
+
+// 恢复到 g。g->map 是同一张地图时沿用（整栋房子模式必须是同一栋房子），否则按编号从地图包取
+// 地图不可用时返回 0，g 不变
+int snapshot_restore(GameContext *g, const void *buf);
+
+// 快照环：每隔几步存一份，空间或位置用完时丢掉最旧的，留下的总是最近连续的一段
+#define SNAPSHOT_RING_BYTES (64 * 1024)
+#define SNAPSHOT_RING_SLOTS 256
+
+typedef struct {
+    unsigned char data[SNAPSHOT_RING_BYTES];
+    struct {
+        uint32_t off, size;
+        int32_t tick;           // 存的时候是第几步 (game_time)
+    } slot[SNAPSHOT_RING_SLOTS];
+    int first, count;           // 最旧的一份在 slot[first]
+    uint32_t tail;              // 下一份从 data 的这个位置开始写
+} SnapshotRing;
+
+void snapshots_clear(SnapshotRing *r);
+void snapshots_push(SnapshotRing *r, const GameContext *g);
+
+// 第 i 新的一份（0 是最新的），没有时返回 NULL
+const void *snapshots_get(const SnapshotRing *r, int i, int *tick);
+
+// 只留下最旧的 keep 份，倒退以后丢掉比恢复点新的
+void snapshots_truncate(SnapshotRing *r, int keep);
+
+#endif
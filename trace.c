@@ -0,0 +1,79 @@
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "trace.h"
+
+const char *const trace_phase_names[PHASE_COUNT] = {
+    "input", "update", "draw_map", "draw_player", "draw_npcs", "draw_ui",
+    "draw_other", "flush", "refresh", "sleep"
+};
+
+static TraceEvent ring[TRACE_CAPACITY];
+static _Atomic uint64_t ring_head = 0;  // 一共写过多少条，写位置是 head % TRACE_CAPACITY
+
+void trace_record(TracePhase phase, uint64_t start, uint64_t end) {
+    uint64_t h = atomic_load_explicit(&ring_head, memory_order_relaxed);
+    TraceEvent *e = &ring[h & (TRACE_CAPACITY - 1)];
+    
+    e->start = start;
+    e->dur = end - start > UINT32_MAX ? UINT32_MAX : (uint32_t)(end - start);
+    e->phase = phase;
+    // 先写完记录再发布新的 head，读的一方按 head 取到的都是完整记录
+    atomic_store_explicit(&ring_head, h + 1, memory_order_release);
+}
+
+static int cmp_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+void trace_summary(TraceStats out[PHASE_COUNT]) {
+    static uint32_t samples[PHASE_COUNT][TRACE_WINDOW];
+    int n[PHASE_COUNT] = { 0 };
+    int full = 0;
+    uint64_t h = atomic_load_explicit(&ring_head, memory_order_acquire);
+    uint64_t oldest = h > TRACE_CAPACITY ? h - TRACE_CAPACITY : 0;
+    
+    // 从最新的记录往回找，每个阶段取够 TRACE_WINDOW 次或者缓冲区读完为止
+    for (uint64_t i = h; i > oldest && full < PHASE_COUNT; i--) {
+        const TraceEvent *e = &ring[(i - 1) & (TRACE_CAPACITY - 1)];
+        int p = e->phase;
+        if (n[p] < TRACE_WINDOW) {
+            samples[p][n[p]++] = e->dur;
+            full += n[p] == TRACE_WINDOW;
+        }
+    }
+    
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        out[p].samples = n[p];
+        out[p].p50 = out[p].p99 = 0;
+        if (n[p] == 0) continue;
+        
+        qsort(samples[p], n[p], sizeof(uint32_t), cmp_u32);
+        out[p].p50 = samples[p][(n[p] - 1) * 50 / 100];
+        out[p].p99 = samples[p][(n[p] - 1) * 99 / 100];
+    }
+}
+
+int trace_export(const char *path) {
+    FILE *f = fopen(path, "w");
+    if (!f) return 0;
+    
+    uint64_t h = atomic_load_explicit(&ring_head, memory_order_acquire);
+    uint64_t oldest = h > TRACE_CAPACITY ? h - TRACE_CAPACITY : 0;
+    
+    // 时间单位是微秒，"X" 是带时长的完整事件；等待和其他阶段分在两条线上，方便看每帧的空闲时间
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(f, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"main\"}},\n");
+    fprintf(f, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"sleep\"}}");
+    for (uint64_t i = oldest; i < h; i++) {
+        const TraceEvent *e = &ring[i & (TRACE_CAPACITY - 1)];
+        fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%llu.%03u,\"dur\":%u.%03u}",
+                trace_phase_names[e->phase], e->phase == PHASE_SLEEP ? 2 : 1,
+                (unsigned long long)(e->start / 1000), (unsigned)(e->start % 1000),
+                e->dur / 1000, e->dur % 1000);
+    }
+    fprintf(f, "\n]}\n");
+    return fclose(f) == 0;
+}
@@ -0,0 +1,66 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <time.h>
+
+// 热路径计时：主循环每个阶段前后各取一次单调时钟，写进一个环形缓冲区
+// 写入不加锁也不分配内存，只有一个写入者（主循环），缓冲区满了就覆盖最旧的记录
+// 界面用 trace_summary 算每个阶段最近的 p50/p99，trace_export 导出 Chrome 跟踪格式 (chrome://tracing, Perfetto)
+
+typedef enum {
+    PHASE_INPUT,        // 读按键并处理
+    PHASE_UPDATE,       // 模拟步
+    PHASE_DRAW_MAP,
+    PHASE_DRAW_PLAYER,
+    PHASE_DRAW_NPCS,
+    PHASE_DRAW_UI,
+    PHASE_DRAW_OTHER,   // 菜单、结算界面、统计行和计时面板
+    PHASE_FLUSH,        // 比较前后两帧，把变化推送给 ncurses
+    PHASE_REFRESH,      // refresh()，真正写终端
+    PHASE_SLEEP,        // 在 poll 里等按键或定时器
+    PHASE_COUNT
+} TracePhase;
+
+extern const char *const trace_phase_names[PHASE_COUNT];
+
+// 环形缓冲区的容量（2的幂），30帧/秒时大约能存三分钟
+#define TRACE_CAPACITY 65536
+
+// 每个阶段统计最近多少次
+#define TRACE_WINDOW 256
+
+typedef struct {
+    uint64_t start;     // 开始时间，纳秒
+    uint32_t dur;       // 耗时，纳秒
+    uint32_t phase;     // TracePhase
+} TraceEvent;
+
+typedef struct {
+    int samples;        // 窗口里有几次记录
+    uint32_t p50, p99;  // 纳秒
+} TraceStats;
+
+static inline uint64_t trace_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+// 记下一个阶段的开始和结束时间
+void trace_record(TracePhase phase, uint64_t start, uint64_t end);
+
+// 计时执行一条语句
+#define TRACE_TIMED(phase, stmt) do { \
+        uint64_t trace_t0_ = trace_now(); \
+        stmt; \
+        trace_record(phase, trace_t0_, trace_now()); \
+    } while (0)
+
+// 每个阶段最近 TRACE_WINDOW 次的耗时分位数
+void trace_summary(TraceStats out[PHASE_COUNT]);
+
+// 把缓冲区里的全部记录写成 Chrome trace-event JSON，失败返回 0
+int trace_export(const char *path);
+
+#endif